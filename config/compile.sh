@@ -13,5 +13,5 @@ export LIBRARY_PATH=$3
 gcc -lm -lopencv_core -lopencv_imgproc -lopencv_highgui \
  -lopencv_imgcodecs -lopencv_video -lopencv_videoio \
  -lopencv_tracking \
- -lstdc++ -o $fname $sfname
+ -lstdc++ -pthread -o $fname $sfname
 
@@ -0,0 +1,249 @@
+/* annot_io.h
+ *
+ * Reading and writing of the bounding box annotations.
+ *
+ * Two formats are supported and read_box() recognises either of them:
+ *
+ *  - text : one "[w x h from (x, y)]" line per frame, as written by
+ *           operator<<(Rect2d), the format of the existing .txt files
+ *  - binary (.bin) : a 16 byte header followed by fixed size records
+ *           { uint32 frame; float x, y, width, height; }, which can be
+ *           memory-mapped and used in place with AnnotMap
+ *
+ * The text parser runs over the memory-mapped file with std::from_chars,
+ * without building a string per line.
+ */
+
+#ifndef ANNOT_IO_H
+#define ANNOT_IO_H
+
+#include <opencv2/core.hpp>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char ANNOT_MAGIC[4] = { 'M', 'V', 'B', 'X' };
+static const uint32_t ANNOT_VERSION = 1;
+
+struct AnnotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;         // number of records following the header
+    uint32_t reserved;
+};
+
+struct AnnotRecord {
+    uint32_t frame;
+    float x, y, width, height;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fname) : m_data(0), m_size(0) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                m_data = (const char*) p;
+                m_size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (m_data) {
+            munmap((void*) m_data, m_size);
+        }
+    }
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_data;
+    size_t m_size;
+};
+
+inline bool is_binary_annot(const char* data, size_t size) {
+    return size >= sizeof(AnnotHeader) && memcmp(data, ANNOT_MAGIC, 4) == 0;
+}
+
+// number of records of a binary annotation mapping, the header count clipped
+// to what the file holds, 0 if it is not a binary file of this version
+inline size_t annot_record_count(const char* data, size_t size) {
+    if (!is_binary_annot(data, size) || ((const AnnotHeader*) data)->version != ANNOT_VERSION) {
+        return 0;
+    }
+    size_t fits = (size - sizeof(AnnotHeader)) / sizeof(AnnotRecord);
+    size_t count = ((const AnnotHeader*) data)->count;
+    return count < fits ? count : fits;
+}
+
+// Binary annotation file used in place, records()[i] is read straight from the mapping
+class AnnotMap {
+public:
+    explicit AnnotMap(const std::string& fname) : m_file(fname), m_count(0) {
+        if (m_file.data()) {
+            m_count = annot_record_count(m_file.data(), m_file.size());
+        }
+    }
+
+    bool valid() const { return m_count > 0; }
+    size_t size() const { return m_count; }
+
+    const AnnotRecord* records() const {
+        return (const AnnotRecord*) (m_file.data() + sizeof(AnnotHeader));
+    }
+
+private:
+    MappedFile m_file;
+    size_t m_count;
+};
+
+inline std::vector<cv::Rect2d> parse_box_text(const char* p, const char* end) {
+/*
+ * Parse "[w x h from (x, y)]" lines, the 4 numbers of a line are taken in
+ * order and a line with less than 4 numbers gives an empty box
+ */
+    std::vector<cv::Rect2d> read;
+    read.reserve((end - p) / 24);
+
+    while (p < end) {
+        const char* eol = (const char*) memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+
+        const char* line = p;
+        double v[4];
+        int n = 0;
+        while (p < eol && n < 4) {
+            char c = *p;
+            if ((c >= '0' && c <= '9') || c == '-' || c == '.') {
+                std::from_chars_result r = std::from_chars(p, eol, v[n]);
+                if (r.ec == std::errc()) {
+                    p = r.ptr;
+                    n++;
+                    continue;
+                }
+            }
+            p++;
+        }
+
+        // skip blank lines (e.g. trailing newline) but keep malformed ones aligned
+        bool blank = true;
+        for (const char* q = line; q < eol && blank; q++) {
+            blank = (*q == ' ' || *q == '\t' || *q == '\r');
+        }
+        if (n == 4) {
+            read.push_back(cv::Rect2d(v[2], v[3], v[0], v[1]));
+        }
+        else if (!blank) {
+            read.push_back(cv::Rect2d());
+        }
+        p = eol + 1;
+    }
+
+    return read;
+}
+
+inline std::vector<cv::Rect2d> read_box(const std::string& fname) {
+/*
+ * Read a saved annotation file (text or binary) into a list of Rect2d,
+ * binary records are placed at their frame index.  The file is mapped once,
+ * the format is told by the magic at its start.
+ */
+    MappedFile file(fname);
+    if (!file.data()) {
+        std::cerr << "(read_box) Could not read " << fname << std::endl;
+        return std::vector<cv::Rect2d>();
+    }
+
+    if (!is_binary_annot(file.data(), file.size())) {
+        return parse_box_text(file.data(), file.data() + file.size());
+    }
+
+    uint32_t version = ((const AnnotHeader*) file.data())->version;
+    if (version != ANNOT_VERSION) {
+        std::cerr << "(read_box) " << fname << " is version " << version
+                  << ", only version " << ANNOT_VERSION << " is supported" << std::endl;
+        return std::vector<cv::Rect2d>();
+    }
+
+    // a file of n records holds frames 0 to n - 1, a larger frame id is corrupt
+    // and would otherwise size the list from garbage
+    size_t count = annot_record_count(file.data(), file.size());
+    const AnnotRecord* rec = (const AnnotRecord*) (file.data() + sizeof(AnnotHeader));
+    std::vector<cv::Rect2d> read;
+    for (size_t i = 0; i < count; i++) {
+        if (rec[i].frame >= count) {
+            std::cerr << "(read_box) Corrupt record " << i << " in " << fname
+                      << ": frame " << rec[i].frame << " of " << count << std::endl;
+            return std::vector<cv::Rect2d>();
+        }
+        if (rec[i].frame >= read.size()) {
+            read.resize(rec[i].frame + 1);
+        }
+        read[rec[i].frame] = cv::Rect2d(rec[i].x, rec[i].y, rec[i].width, rec[i].height);
+    }
+    return read;
+}
+
+inline void save_box(const std::vector<cv::Rect2d>& bounds, const std::string& fname) {
+/*
+ * Save boundaries to file (txt), one operator<< line per frame
+ */
+    std::ofstream fp;
+    fp.open(fname);
+
+    for (size_t i = 0; i < bounds.size(); i++) {
+        fp << bounds[i] << "\n";
+    }
+
+    fp.close();
+}
+
+inline void save_box_bin(const std::vector<cv::Rect2d>& bounds, const std::string& fname) {
+/*
+ * Save boundaries to file (binary), record i is frame i
+ */
+    AnnotHeader h;
+    memcpy(h.magic, ANNOT_MAGIC, 4);
+    h.version = ANNOT_VERSION;
+    h.count = (uint32_t) bounds.size();
+    h.reserved = 0;
+
+    std::vector<AnnotRecord> rec(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        rec[i].frame = (uint32_t) i;
+        rec[i].x = (float) bounds[i].x;
+        rec[i].y = (float) bounds[i].y;
+        rec[i].width = (float) bounds[i].width;
+        rec[i].height = (float) bounds[i].height;
+    }
+
+    std::ofstream fp;
+    fp.open(fname, std::ios::binary);
+    fp.write((const char*) &h, sizeof(h));
+    fp.write((const char*) rec.data(), rec.size() * sizeof(AnnotRecord));
+    fp.close();
+}
+
+#endif
@@ -0,0 +1,148 @@
+/* auto_exposure.h
+ *
+ * Adaptive gamma and brightness / contrast correction for footage swinging
+ * between shadow and sun, instead of choosing the vid_corr.cpp parameters by
+ * hand for each clip.
+ *
+ * A running luminance histogram is kept over the frames: each frame adds the
+ * histogram of a subsampled pixel grid, whose offset moves from one frame to
+ * the next so the whole image is covered over step * step frames, with an
+ * exponential forgetting of the older frames.  From it:
+ *
+ *   gamma       brings the mean luminance to mid-grey
+ *   alpha, beta stretch the 1% - 99% luminance range, after gamma, to 0 - 255
+ *
+ * The correction table is only rebuilt when a parameter moves by more than the
+ * tolerance, so on steady footage a frame costs the grid histogram only.
+ */
+
+#ifndef AUTO_EXPOSURE_H
+#define AUTO_EXPOSURE_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include "img_corr.h"
+
+class AutoExposure {
+public:
+
+    // step: grid subsampling, smoothing: weight of the new frame in the histogram,
+    // tolerance: relative change of a parameter that rebuilds the table
+    explicit AutoExposure(int step = 4, double smoothing = 0.1, double tolerance = 0.02)
+        : step(std::max(1, step)), smoothing(smoothing), tolerance(tolerance),
+          n_frames(0), gamma_(1.0), alpha_(1.0), beta_(0.0), n_rebuilds(0) {
+        std::fill(hist, hist + 256, 0.0);
+        lut = gamma_bc_lut(gamma_, alpha_, beta_);
+    }
+
+    // add frame to the running histogram, true if the table was rebuilt
+    bool update(const cv::Mat& frame) {
+        CV_Assert(frame.depth() == CV_8U && (frame.channels() == 1 || frame.channels() == 3));
+
+        double frame_hist[256];
+        sample_histogram(frame, frame_hist);
+        double w = n_frames == 0 ? 1.0 : smoothing;
+        for (int i = 0; i < 256; i++) {
+            hist[i] = (1.0 - w) * hist[i] + w * frame_hist[i];
+        }
+        n_frames++;
+
+        double gamma, alpha, beta;
+        estimate(gamma, alpha, beta);
+        if (n_rebuilds > 0 &&
+            fabs(gamma - gamma_) <= tolerance * gamma_ &&
+            fabs(alpha - alpha_) <= tolerance * alpha_ &&
+            fabs(beta - beta_) <= tolerance * 255) {
+            return false;
+        }
+        gamma_ = gamma;
+        alpha_ = alpha;
+        beta_ = beta;
+        lut = gamma_bc_lut(gamma_, alpha_, beta_);
+        n_rebuilds++;
+        return true;
+    }
+
+    void apply(const cv::Mat& src, cv::Mat& dst) const {
+        apply_lut(src, lut, dst);
+    }
+
+    const cv::Mat& table() const { return lut; }
+    double gamma() const { return gamma_; }
+    double alpha() const { return alpha_; }
+    double beta() const { return beta_; }
+    int rebuilds() const { return n_rebuilds; }
+
+private:
+
+    // normalized luminance histogram of the pixels of the grid for this frame
+    void sample_histogram(const cv::Mat& frame, double* out) const {
+        int counts[256] = { 0 };
+        const int cn = frame.channels();
+        const int y0 = (int) (n_frames % step);
+        const int x0 = (int) ((n_frames / step) % step);
+        int total = 0;
+
+        for (int y = y0; y < frame.rows; y += step) {
+            const uchar* p = frame.ptr<uchar>(y);
+            if (cn == 1) {
+                for (int x = x0; x < frame.cols; x += step) {
+                    counts[p[x]]++;
+                }
+            }
+            else {
+                // BT.601 luma of BGR, integer weights summing to 256
+                for (int x = x0; x < frame.cols; x += step) {
+                    const uchar* q = p + 3 * x;
+                    counts[(29 * q[0] + 150 * q[1] + 77 * q[2]) >> 8]++;
+                }
+            }
+            total += (frame.cols - x0 + step - 1) / step;
+        }
+
+        for (int i = 0; i < 256; i++) {
+            out[i] = total > 0 ? (double) counts[i] / total : 0.0;
+        }
+    }
+
+    // luminance at which the cumulative histogram reaches q
+    double quantile(double q) const {
+        double cum = 0.0;
+        for (int i = 0; i < 256; i++) {
+            cum += hist[i];
+            if (cum >= q) {
+                return i;
+            }
+        }
+        return 255;
+    }
+
+    void estimate(double& gamma, double& alpha, double& beta) const {
+        double mean = 0.0;
+        for (int i = 0; i < 256; i++) {
+            mean += i * hist[i];
+        }
+        mean = std::min(std::max(mean / 255, 0.02), 0.98);
+        gamma = std::min(std::max(log(0.5) / log(mean), 0.3), 3.0);
+
+        // range after gamma, stretched without amplifying more than 3 times
+        double lo = 255 * pow(quantile(0.01) / 255, gamma);
+        double hi = 255 * pow(quantile(0.99) / 255, gamma);
+        alpha = std::min(std::max(255 / std::max(hi - lo, 1.0), 1.0), 3.0);
+        beta = -alpha * lo;
+    }
+
+    int step;
+    double smoothing;
+    double tolerance;
+    long n_frames;
+    double hist[256];
+    double gamma_;
+    double alpha_;
+    double beta_;
+    int n_rebuilds;
+    cv::Mat lut;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* bc_kernels.h
+ *
+ * Fixed-point row kernels for the brightness / contrast transform
+ * dst = saturate(alpha * src + beta) on 8-bit values, for the boards without
+ * fast floating-point.  As lut_kernels.h, they only depend on the compiler and
+ * the selection for the CPU is done in img_corr.h.
+ *
+ * All kernels compute exactly the same integers, in 16-bit lanes:
+ *
+ *   t = ((src << 8) * A) >> 16      A = alpha in Q3.13, t = alpha * src in Q11.5
+ *   t = t -sat B_neg +sat B_pos     beta in Q.5, the +16 of the rounding in B_pos
+ *   dst = min(t >> 5, 255)
+ *
+ * which stays within 1 of the double computation as long as the parameters
+ * are representable: 0 <= alpha < 8 and |beta| < 256.
+ *
+ *   bc_row_scalar : reference implementation, any CPU
+ *   bc_row_sse2   : x86, pmulhuw, part of x86-64
+ *   bc_row_avx2   : x86, same with 32 bytes per step
+ *   bc_row_neon   : aarch64, umull and narrowing shifts
+ *
+ * src == dst (in-place) is allowed.
+ */
+
+#ifndef BC_KERNELS_H
+#define BC_KERNELS_H
+
+#include <cmath>
+#include "lut_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BC_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define BC_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+struct BcFixed {
+    unsigned short a;       // alpha, Q3.13
+    unsigned short b_pos;   // positive beta, Q.5, plus the rounding
+    unsigned short b_neg;   // negative beta, Q.5
+};
+
+inline bool bc_fixed_representable(double alpha, double beta) {
+    return alpha >= 0 && alpha * 8192 + 0.5 < 65536 && fabs(beta) < 256;
+}
+
+inline BcFixed bc_fixed_params(double alpha, double beta) {
+    BcFixed p;
+    int b = (int) lround(beta * 32);
+    p.a = (unsigned short) lround(alpha * 8192);
+    p.b_pos = (unsigned short) ((b > 0 ? b : 0) + 16);
+    p.b_neg = (unsigned short) (b < 0 ? -b : 0);
+    return p;
+}
+
+inline void bc_row_scalar(const lut_uchar* src, lut_uchar* dst, int n, const BcFixed& p) {
+    for (int i = 0; i < n; i++) {
+        int t = (int) (((unsigned) src[i] << 8) * p.a >> 16);
+        t = t > p.b_neg ? t - p.b_neg : 0;
+        t = t + p.b_pos < 65535 ? t + p.b_pos : 65535;
+        t >>= 5;
+        dst[i] = (lut_uchar) (t < 255 ? t : 255);
+    }
+}
+
+#ifdef BC_KERNELS_X86
+
+// interleaving with zero bytes below gives src << 8 in each 16-bit lane
+inline void bc_row_sse2(const lut_uchar* src, lut_uchar* dst, int n, const BcFixed& p) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16((short) p.a);
+    const __m128i b_pos = _mm_set1_epi16((short) p.b_pos);
+    const __m128i b_neg = _mm_set1_epi16((short) p.b_neg);
+
+    int i = 0;
+    for (; i <= n - 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, v), a);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, v), a);
+        lo = _mm_adds_epu16(_mm_subs_epu16(lo, b_neg), b_pos);
+        hi = _mm_adds_epu16(_mm_subs_epu16(hi, b_neg), b_pos);
+        // at most 2047 after the shift, so the signed saturation of packus is fine
+        __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 5), _mm_srli_epi16(hi, 5));
+        _mm_storeu_si128((__m128i*) (dst + i), r);
+    }
+    bc_row_scalar(src + i, dst + i, n - i, p);
+}
+
+__attribute__((target("avx2")))
+inline void bc_row_avx2(const lut_uchar* src, lut_uchar* dst, int n, const BcFixed& p) {
+    // unpack and pack both work within the 128-bit lanes, the order is kept
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a = _mm256_set1_epi16((short) p.a);
+    const __m256i b_pos = _mm256_set1_epi16((short) p.b_pos);
+    const __m256i b_neg = _mm256_set1_epi16((short) p.b_neg);
+
+    int i = 0;
+    for (; i <= n - 32; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, v), a);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, v), a);
+        lo = _mm256_adds_epu16(_mm256_subs_epu16(lo, b_neg), b_pos);
+        hi = _mm256_adds_epu16(_mm256_subs_epu16(hi, b_neg), b_pos);
+        __m256i r = _mm256_packus_epi16(_mm256_srli_epi16(lo, 5), _mm256_srli_epi16(hi, 5));
+        _mm256_storeu_si256((__m256i*) (dst + i), r);
+    }
+    bc_row_scalar(src + i, dst + i, n - i, p);
+}
+
+#endif
+
+#ifdef BC_KERNELS_NEON
+
+inline void bc_row_neon(const lut_uchar* src, lut_uchar* dst, int n, const BcFixed& p) {
+    const uint16x4_t a = vdup_n_u16(p.a);
+    const uint16x8_t b_pos = vdupq_n_u16(p.b_pos);
+    const uint16x8_t b_neg = vdupq_n_u16(p.b_neg);
+
+    int i = 0;
+    for (; i <= n - 16; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint16x8_t x[2] = { vshll_n_u8(vget_low_u8(v), 8), vshll_n_u8(vget_high_u8(v), 8) };
+        uint8x8_t r[2];
+        for (int h = 0; h < 2; h++) {
+            uint16x8_t t = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(x[h]), a), 16),
+                                        vshrn_n_u32(vmull_u16(vget_high_u16(x[h]), a), 16));
+            t = vqaddq_u16(vqsubq_u16(t, b_neg), b_pos);
+            r[h] = vqmovn_u16(vshrq_n_u16(t, 5));
+        }
+        vst1q_u8(dst + i, vcombine_u8(r[0], r[1]));
+    }
+    bc_row_scalar(src + i, dst + i, n - i, p);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+/* eval_metrics.h
+ *
+ * Streaming OTB-style success and precision curves for tracker evaluation.
+ *
+ * Every evaluated frame is dropped into two pre-binned histograms (IoU and
+ * centre location error) instead of being stored, so the memory used does not
+ * depend on the length of the clip, and the results of several clips, trackers
+ * or workers are merged by simply adding the bins together.
+ *
+ *   success plot   : ratio of frames with IoU > t,            t = 0, 0.05, ..., 1
+ *   precision plot : ratio of frames with centre error <= t,  t = 0, 1, ..., 50 px
+ *   AUC            : mean of the success plot
+ *
+ * VotStats holds the VOT-style accuracy / robustness pair obtained with the
+ * re-initialisation protocol: the number of failures, and the mean IoU of the
+ * frames tracked outside the burn-in period that follows each initialisation.
+ */
+
+#ifndef EVAL_METRICS_H
+#define EVAL_METRICS_H
+
+#include <opencv2/core.hpp>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "iou.h"
+
+class TrackingCurves {
+public:
+    // number of IoU threshold steps over [0,1] and largest pixel threshold, as in OTB
+    static const int IOU_STEPS = 20;
+    static const int CLE_MAX = 50;
+
+    TrackingCurves() {
+        reset();
+    }
+
+    void reset() {
+        memset(iou_hist, 0, sizeof(iou_hist));
+        memset(cle_hist, 0, sizeof(cle_hist));
+        n_frames = 0;
+        n_failures = 0;
+        iou_sum = 0.0;
+    }
+
+    // account one frame where the tracker gave a box
+    void add(double iou, double cle) {
+        // bin b holds the IoUs in (t_b-1, t_b], so "IoU > t_k" is the sum of the bins above k
+        int b = (int) std::ceil(iou * IOU_STEPS);
+        b = b < 0 ? 0 : (b > IOU_STEPS ? IOU_STEPS : b);
+        iou_hist[b]++;
+
+        // bin c holds the errors in (c-1, c], the last bin is everything above CLE_MAX
+        int c = CLE_MAX + 1;
+        if (std::isfinite(cle) && cle <= CLE_MAX) {
+            c = (int) std::ceil(cle);
+            c = c < 0 ? 0 : c;
+        }
+        cle_hist[c]++;
+
+        n_frames++;
+        iou_sum += iou;
+    }
+
+    void add(const cv::Rect2d& annotbox, const cv::Rect2d& trackingbox, double iou) {
+        add(iou, centre_error(annotbox, trackingbox));
+    }
+
+    // account one frame where the tracker reported a failure
+    void add_failure() {
+        n_failures++;
+        add(0.0, INFINITY);
+    }
+
+    TrackingCurves& operator+=(const TrackingCurves& other) {
+        for (int i = 0; i <= IOU_STEPS; i++) {
+            iou_hist[i] += other.iou_hist[i];
+        }
+        for (int i = 0; i <= CLE_MAX + 1; i++) {
+            cle_hist[i] += other.cle_hist[i];
+        }
+        n_frames += other.n_frames;
+        n_failures += other.n_failures;
+        iou_sum += other.iou_sum;
+        return *this;
+    }
+
+    // success rate at the k-th IoU threshold (k / IOU_STEPS)
+    double success(int k) const {
+        if (n_frames == 0) {
+            return 0.0;
+        }
+        unsigned long long above = 0;
+        for (int b = k + 1; b <= IOU_STEPS; b++) {
+            above += iou_hist[b];
+        }
+        return (double) above / n_frames;
+    }
+
+    // precision at a centre error threshold of t pixels
+    double precision(int t) const {
+        if (n_frames == 0) {
+            return 0.0;
+        }
+        unsigned long long below = 0;
+        for (int c = 0; c <= t && c <= CLE_MAX; c++) {
+            below += cle_hist[c];
+        }
+        return (double) below / n_frames;
+    }
+
+    double auc() const {
+        double sum = 0.0;
+        for (int k = 0; k <= IOU_STEPS; k++) {
+            sum += success(k);
+        }
+        return sum / (IOU_STEPS + 1);
+    }
+
+    double mean_iou() const {
+        return n_frames ? iou_sum / n_frames : 0.0;
+    }
+
+    unsigned long long frames() const {
+        return n_frames;
+    }
+
+    unsigned long long failures() const {
+        return n_failures;
+    }
+
+    // one line summary, plus both curves when verbose
+    void print(std::ostream& os, const std::string& name, bool verbose = false) const {
+        os << std::fixed << std::setprecision(4)
+           << name << ": frames " << n_frames
+           << ", failures " << n_failures
+           << ", mean IoU " << mean_iou()
+           << ", AUC " << auc()
+           << ", precision@20px " << precision(20) << std::endl;
+
+        if (verbose) {
+            os << "  success  ";
+            for (int k = 0; k <= IOU_STEPS; k++) {
+                os << " " << success(k);
+            }
+            os << std::endl << "  precision";
+            for (int t = 0; t <= CLE_MAX; t++) {
+                os << " " << precision(t);
+            }
+            os << std::endl;
+        }
+    }
+
+    // plain text form of the bins, to pass partial results between processes
+    void write(std::ostream& os) const {
+        os << n_frames << " " << n_failures << " "
+           << std::setprecision(17) << iou_sum;
+        for (int i = 0; i <= IOU_STEPS; i++) {
+            os << " " << iou_hist[i];
+        }
+        for (int i = 0; i <= CLE_MAX + 1; i++) {
+            os << " " << cle_hist[i];
+        }
+        os << std::endl;
+    }
+
+    bool read(std::istream& is) {
+        is >> n_frames >> n_failures >> iou_sum;
+        for (int i = 0; i <= IOU_STEPS; i++) {
+            is >> iou_hist[i];
+        }
+        for (int i = 0; i <= CLE_MAX + 1; i++) {
+            is >> cle_hist[i];
+        }
+        return !is.fail();
+    }
+
+private:
+    unsigned long long iou_hist[IOU_STEPS + 1];
+    unsigned long long cle_hist[CLE_MAX + 2];
+    unsigned long long n_frames;
+    unsigned long long n_failures;
+    double iou_sum;
+};
+
+class VotStats {
+public:
+    VotStats() : n_failures(0), n_tracked(0), n_accuracy(0), accuracy_sum(0.0) {}
+
+    // frame on which the tracker was run
+    void add_tracked() {
+        n_tracked++;
+    }
+
+    void add_failure() {
+        n_failures++;
+    }
+
+    // IoU of a tracked frame outside the burn-in period
+    void add_accuracy(double iou) {
+        n_accuracy++;
+        accuracy_sum += iou;
+    }
+
+    VotStats& operator+=(const VotStats& other) {
+        n_failures += other.n_failures;
+        n_tracked += other.n_tracked;
+        n_accuracy += other.n_accuracy;
+        accuracy_sum += other.accuracy_sum;
+        return *this;
+    }
+
+    double accuracy() const {
+        return n_accuracy ? accuracy_sum / n_accuracy : 0.0;
+    }
+
+    unsigned long long failures() const {
+        return n_failures;
+    }
+
+    // failures per 100 tracked frames, comparable between clips of any length
+    double robustness() const {
+        return n_tracked ? 100.0 * n_failures / n_tracked : 0.0;
+    }
+
+    void print(std::ostream& os, const std::string& name) const {
+        os << std::fixed << std::setprecision(4)
+           << name << ": tracked frames " << n_tracked
+           << ", failures " << n_failures
+           << ", robustness " << robustness() << " failures/100 frames"
+           << ", accuracy " << accuracy() << std::endl;
+    }
+
+private:
+    unsigned long long n_failures;
+    unsigned long long n_tracked;
+    unsigned long long n_accuracy;
+    double accuracy_sum;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/* img_corr.h
+ *
+ * Photometric corrections of 8-bit frames, shared by vid_corr.cpp
+ * (offline correction of a video) and eval.cpp (robustness sweeps).
+ *
+ *   bc_adjust  : brightness / contrast, alpha * p + beta
+ *   gamma_corr : gamma correction, 255 * (p / 255) ^ gamma
+ *
+ * Both are per-channel point operations on 8-bit values, so they are computed
+ * once per parameter set as a 256-entry table (gamma_lut, bc_lut) and applied
+ * by apply_lut.  Chained corrections are collapsed into a single table with
+ * compose_lut, e.g. gamma_bc_lut.  The tables give exactly the values of the
+ * former per-pixel computation.
+ *
+ * apply_lut processes stripes of rows in parallel, each with the row kernel of
+ * lut_kernels.h chosen for the CPU at run time (LUT_AUTO), and works in-place
+ * when the destination is the source.
+ *
+ * Brightness / contrast alone is cheaper as fixed-point arithmetic in 16-bit
+ * lanes than as a table lookup: apply_bc uses the kernels of bc_kernels.h when
+ * the parameters are representable and a SIMD kernel exists for the CPU (within
+ * 1 of the table), the table otherwise.
+ */
+
+#ifndef IMG_CORR_H
+#define IMG_CORR_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <cmath>
+#include "lut_kernels.h"
+#include "bc_kernels.h"
+
+inline cv::Mat gamma_lut(double gamma) {
+    cv::Mat lut(1, 256, CV_8U);
+    uchar* t = lut.ptr<uchar>();
+    for (int i = 0; i < 256; i++) {
+        t[i] = cv::saturate_cast<uchar>( pow( (double) i/255, gamma ) * 255 );
+    }
+    return lut;
+}
+
+inline cv::Mat bc_lut(double alpha, double beta) {
+    cv::Mat lut(1, 256, CV_8U);
+    uchar* t = lut.ptr<uchar>();
+    for (int i = 0; i < 256; i++) {
+        t[i] = cv::saturate_cast<uchar>( alpha*i + beta );
+    }
+    return lut;
+}
+
+// table applying first, then second
+inline cv::Mat compose_lut(const cv::Mat& first, const cv::Mat& second) {
+    cv::Mat lut(1, 256, CV_8U);
+    const uchar* f = first.ptr<uchar>();
+    const uchar* s = second.ptr<uchar>();
+    uchar* t = lut.ptr<uchar>();
+    for (int i = 0; i < 256; i++) {
+        t[i] = s[f[i]];
+    }
+    return lut;
+}
+
+// gamma correction followed by brightness / contrast, as a single table
+inline cv::Mat gamma_bc_lut(double gamma, double alpha, double beta) {
+    return compose_lut(gamma_lut(gamma), bc_lut(alpha, beta));
+}
+
+enum LutPath { LUT_AUTO, LUT_SCALAR, LUT_SSSE3, LUT_AVX2, LUT_NEON };
+
+typedef void (*LutRowKernel)(const lut_uchar*, lut_uchar*, int, const lut_uchar*);
+
+inline const char* lut_path_name(int path) {
+    static const char* names[] = { "auto", "scalar", "ssse3", "avx2", "neon" };
+    return names[path];
+}
+
+// kernel of a path, 0 if it is not compiled in or not supported by the CPU
+inline LutRowKernel lut_kernel(int path) {
+    switch (path) {
+        case LUT_SCALAR:
+            return lut_row_scalar;
+#ifdef LUT_KERNELS_X86
+        case LUT_SSSE3:
+            return cv::checkHardwareSupport(CV_CPU_SSSE3) ? lut_row_ssse3 : 0;
+        case LUT_AVX2:
+            return cv::checkHardwareSupport(CV_CPU_AVX2) ? lut_row_avx2 : 0;
+#endif
+#ifdef LUT_KERNELS_NEON
+        case LUT_NEON:
+            return lut_row_neon;
+#endif
+        default:
+            return 0;
+    }
+}
+
+// SSSE3 is not picked: 16 pshufb per 16 bytes are slower than scalar loads
+inline int lut_best_path() {
+    static const int best = lut_kernel(LUT_AVX2) ? LUT_AVX2 :
+                            lut_kernel(LUT_NEON) ? LUT_NEON : LUT_SCALAR;
+    return best;
+}
+
+template<typename RowOp>
+inline void for_each_row_striped(const cv::Mat& orig_img, cv::Mat& new_img, const RowOp& op) {
+/*
+ * Run op(src_row, dst_row, row_length) over stripes of rows in parallel.
+ * The header copy is taken first: new_img may be orig_img, create() is then a
+ * no-op and the image is processed in-place.
+ */
+    const cv::Mat src = orig_img;
+    new_img.create(src.size(), src.type());
+    cv::Mat dst = new_img;
+    const int rowlen = src.cols * src.channels();
+
+    // stripes of about 64 kB, enough work per task and few of them per frame
+    double nstripes = (double) src.rows * rowlen / (1 << 16);
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            op(src.ptr<lut_uchar>(y), dst.ptr<lut_uchar>(y), rowlen);
+        }
+    }, nstripes);
+}
+
+inline void apply_lut(const cv::Mat& orig_img, const cv::Mat& lut, cv::Mat& new_img, int path = LUT_AUTO) {
+    CV_Assert(orig_img.depth() == CV_8U && lut.type() == CV_8UC1 && lut.total() == 256);
+
+    LutRowKernel kernel = lut_kernel(path == LUT_AUTO ? lut_best_path() : path);
+    CV_Assert(kernel != 0);
+
+    const cv::Mat table_mat = lut.isContinuous() ? lut : lut.clone();
+    const lut_uchar* table = table_mat.ptr<lut_uchar>();
+    for_each_row_striped(orig_img, new_img, [&](const lut_uchar* src, lut_uchar* dst, int n) {
+        kernel(src, dst, n, table);
+    });
+}
+
+enum BcPath { BC_AUTO, BC_TABLE, BC_SCALAR, BC_SSE2, BC_AVX2, BC_NEON };
+
+typedef void (*BcRowKernel)(const lut_uchar*, lut_uchar*, int, const BcFixed&);
+
+inline const char* bc_path_name(int path) {
+    static const char* names[] = { "auto", "table", "fixed scalar", "fixed sse2", "fixed avx2", "fixed neon" };
+    return names[path];
+}
+
+inline BcRowKernel bc_kernel(int path) {
+    switch (path) {
+        case BC_SCALAR:
+            return bc_row_scalar;
+#ifdef BC_KERNELS_X86
+        case BC_SSE2:
+            return cv::checkHardwareSupport(CV_CPU_SSE2) ? bc_row_sse2 : 0;
+        case BC_AVX2:
+            return cv::checkHardwareSupport(CV_CPU_AVX2) ? bc_row_avx2 : 0;
+#endif
+#ifdef BC_KERNELS_NEON
+        case BC_NEON:
+            return bc_row_neon;
+#endif
+        default:
+            return 0;
+    }
+}
+
+// the scalar fixed-point kernel is slower than the table, it is the reference only
+inline int bc_best_path() {
+    static const int best = bc_kernel(BC_AVX2) ? BC_AVX2 :
+                            bc_kernel(BC_SSE2) ? BC_SSE2 :
+                            bc_kernel(BC_NEON) ? BC_NEON : BC_TABLE;
+    return best;
+}
+
+inline void apply_bc(const cv::Mat& orig_img, double alpha, double beta, cv::Mat& new_img, int path = BC_AUTO) {
+    CV_Assert(orig_img.depth() == CV_8U);
+
+    if (path == BC_AUTO) {
+        path = bc_fixed_representable(alpha, beta) ? bc_best_path() : BC_TABLE;
+    }
+    if (path == BC_TABLE) {
+        apply_lut(orig_img, bc_lut(alpha, beta), new_img);
+        return;
+    }
+
+    BcRowKernel kernel = bc_kernel(path);
+    CV_Assert(kernel != 0 && bc_fixed_representable(alpha, beta));
+    const BcFixed params = bc_fixed_params(alpha, beta);
+    for_each_row_striped(orig_img, new_img, [&](const lut_uchar* src, lut_uchar* dst, int n) {
+        kernel(src, dst, n, params);
+    });
+}
+
+inline cv::Mat bc_adjust(const cv::Mat& orig_img, double alpha, double beta) {
+
+    cv::Mat new_img;
+    apply_bc(orig_img, alpha, beta, new_img);
+    return new_img;
+}
+
+inline cv::Mat gamma_corr(const cv::Mat& orig_img, double gamma) {
+
+    cv::Mat new_img;
+    apply_lut(orig_img, gamma_lut(gamma), new_img);
+    return new_img;
+}
+
+#endif
@@ -0,0 +1,226 @@
+/* iou.h
+ *
+ * IoU, unbiased IoU and centre error between annotation and tracker boxes.
+ *
+ * The scalar functions evaluate one pair of boxes, the *_batch functions work
+ * on structure-of-arrays box sequences with OpenCV universal intrinsics.  Both
+ * go through the very same operations in the very same order, so the batch
+ * results are bit-identical to the scalar ones (as long as the compiler is not
+ * allowed to contract a*b+c into FMA, i.e. no -ffp-contract=fast with -mfma).
+ * The intersection is computed here rather than with Rect2d::operator&, whose
+ * arithmetic, and so its rounding, changed with OpenCV 3.4.14 / 4.5.2.
+ *
+ * The unbiased IoU follows "Countering bias in tracking evaluations"
+ * by G. Hager et al, https://www.scitepress.org/Papers/2018/67148/67148.pdf
+ */
+
+#ifndef IOU_H
+#define IOU_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// area of the intersection of a and d, 0 if they do not overlap
+inline double intersection_area(const cv::Rect2d& a, const cv::Rect2d& d) {
+    double x1 = std::max(a.x, d.x);
+    double y1 = std::max(a.y, d.y);
+    double w = std::min(a.x + a.width, d.x + d.width) - x1;
+    double h = std::min(a.y + a.height, d.y + d.height) - y1;
+    return (w > 0 && h > 0) ? w * h : 0.0;
+}
+
+inline double IoU_eval(const cv::Rect2d& bbox_a, const cv::Rect2d& bbox_d) {
+/* calculate IoU accuracy of label bbox and prediction box */
+
+    // bbox_a: annotation bbox, bbox_d: detection result bbox
+    double A_da = intersection_area(bbox_a, bbox_d);
+    if ( A_da == 0 ) {
+        return 0.0;
+    }
+
+    double A_d1a = bbox_a.area() - A_da;
+    double A_da1 = bbox_d.area() - A_da;
+
+    return A_da / (A_da + A_d1a + A_da1);
+}
+
+inline double unbiased_IoU_eval(const cv::Rect2d& bbox_a, const cv::Rect2d& bbox_d, double A_bg) {
+/* calculate unbiased IoU accuracy of label bbox and prediction bbox */
+
+    // bbox_a: annotation bbox, bbox_d: detection result bbox
+    // if they don't intersect at all => precision = 0
+    double A_da = intersection_area(bbox_a, bbox_d);
+    if ( A_da == 0 ) {
+        return 0.0;
+    }
+
+    // A_d1a1 = A_bg - A_union(bbox_a, bbox_d): background area - area of union of two boxes
+    double A_d1a = bbox_a.area() - A_da;
+    double A_da1 = bbox_d.area() - A_da;
+    double A_d1a1 = A_bg - (A_da + A_d1a + A_da1);
+
+    // squared terms are plain products, pow(x,2) rounds to exactly the same value
+    double fg = A_da + A_da1 + A_d1a;
+    double bg = A_d1a1 + A_da1 + A_d1a;
+    double w0 = (fg * fg) / (fg * fg + bg * bg);
+    double wbg = 1 - w0;
+
+    return   w0  *  A_da / (A_da + A_d1a + A_da1)
+           + wbg * A_d1a1 / (A_d1a1 + A_d1a + A_da1);
+}
+
+// distance between the centres of the annotation and the tracker box
+inline double centre_error(const cv::Rect2d& bbox_a, const cv::Rect2d& bbox_d) {
+    double dx = (bbox_a.x + bbox_a.width / 2) - (bbox_d.x + bbox_d.width / 2);
+    double dy = (bbox_a.y + bbox_a.height / 2) - (bbox_d.y + bbox_d.height / 2);
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+
+// Sequence of boxes stored as one array per coordinate
+struct BoxSeq {
+    std::vector<double> x, y, width, height;
+
+    BoxSeq() {}
+
+    explicit BoxSeq(const std::vector<cv::Rect2d>& boxes) {
+        reserve(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            push_back(boxes[i]);
+        }
+    }
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void reserve(size_t n) {
+        x.reserve(n);
+        y.reserve(n);
+        width.reserve(n);
+        height.reserve(n);
+    }
+
+    void push_back(const cv::Rect2d& box) {
+        x.push_back(box.x);
+        y.push_back(box.y);
+        width.push_back(box.width);
+        height.push_back(box.height);
+    }
+
+    cv::Rect2d at(size_t i) const {
+        return cv::Rect2d(x[i], y[i], width[i], height[i]);
+    }
+};
+
+#if CV_SIMD_64F
+// intersection_area for one register of boxes
+inline cv::v_float64 v_intersection_area(const BoxSeq& a, const BoxSeq& d, int i,
+                                         cv::v_float64& A_a, cv::v_float64& A_d) {
+    cv::v_float64 ax = cv::vx_load(&a.x[i]), ay = cv::vx_load(&a.y[i]);
+    cv::v_float64 aw = cv::vx_load(&a.width[i]), ah = cv::vx_load(&a.height[i]);
+    cv::v_float64 dx = cv::vx_load(&d.x[i]), dy = cv::vx_load(&d.y[i]);
+    cv::v_float64 dw = cv::vx_load(&d.width[i]), dh = cv::vx_load(&d.height[i]);
+
+    cv::v_float64 x1 = cv::v_max(ax, dx);
+    cv::v_float64 y1 = cv::v_max(ay, dy);
+    cv::v_float64 w = cv::v_min(ax + aw, dx + dw) - x1;
+    cv::v_float64 h = cv::v_min(ay + ah, dy + dh) - y1;
+
+    A_a = aw * ah;
+    A_d = dw * dh;
+
+    cv::v_float64 zero = cv::vx_setzero_f64();
+    return cv::v_select((w > zero) & (h > zero), w * h, zero);
+}
+#endif
+
+inline void IoU_batch(const BoxSeq& a, const BoxSeq& d, double* out) {
+/* IoU_eval over two box sequences, out must hold min(a.size(), d.size()) values */
+
+    const int n = (int) std::min(a.size(), d.size());
+    int i = 0;
+
+#if CV_SIMD_64F
+    const int step = cv::v_float64::nlanes;
+    const cv::v_float64 zero = cv::vx_setzero_f64();
+    for (; i <= n - step; i += step) {
+        cv::v_float64 A_a, A_d;
+        cv::v_float64 A_da = v_intersection_area(a, d, i, A_a, A_d);
+        cv::v_float64 A_d1a = A_a - A_da;
+        cv::v_float64 A_da1 = A_d - A_da;
+
+        cv::v_float64 acc = A_da / (A_da + A_d1a + A_da1);
+        cv::v_store(out + i, cv::v_select(A_da == zero, zero, acc));
+    }
+    cv::vx_cleanup();
+#endif
+
+    for (; i < n; i++) {
+        out[i] = IoU_eval(a.at(i), d.at(i));
+    }
+}
+
+inline void unbiased_IoU_batch(const BoxSeq& a, const BoxSeq& d, double A_bg, double* out) {
+/* unbiased_IoU_eval over two box sequences with the same background area */
+
+    const int n = (int) std::min(a.size(), d.size());
+    int i = 0;
+
+#if CV_SIMD_64F
+    const int step = cv::v_float64::nlanes;
+    const cv::v_float64 zero = cv::vx_setzero_f64();
+    const cv::v_float64 one = cv::vx_setall_f64(1.0);
+    const cv::v_float64 bg_area = cv::vx_setall_f64(A_bg);
+    for (; i <= n - step; i += step) {
+        cv::v_float64 A_a, A_d;
+        cv::v_float64 A_da = v_intersection_area(a, d, i, A_a, A_d);
+        cv::v_float64 A_d1a = A_a - A_da;
+        cv::v_float64 A_da1 = A_d - A_da;
+        cv::v_float64 A_d1a1 = bg_area - (A_da + A_d1a + A_da1);
+
+        cv::v_float64 fg = A_da + A_da1 + A_d1a;
+        cv::v_float64 bg = A_d1a1 + A_da1 + A_d1a;
+        cv::v_float64 w0 = (fg * fg) / (fg * fg + bg * bg);
+        cv::v_float64 wbg = one - w0;
+
+        cv::v_float64 acc =   w0 * A_da / (A_da + A_d1a + A_da1)
+                            + wbg * A_d1a1 / (A_d1a1 + A_d1a + A_da1);
+        cv::v_store(out + i, cv::v_select(A_da == zero, zero, acc));
+    }
+    cv::vx_cleanup();
+#endif
+
+    for (; i < n; i++) {
+        out[i] = unbiased_IoU_eval(a.at(i), d.at(i), A_bg);
+    }
+}
+
+inline void centre_error_batch(const BoxSeq& a, const BoxSeq& d, double* out) {
+/* centre_error over two box sequences */
+
+    const int n = (int) std::min(a.size(), d.size());
+    int i = 0;
+
+#if CV_SIMD_64F
+    const int step = cv::v_float64::nlanes;
+    const cv::v_float64 two = cv::vx_setall_f64(2.0);
+    for (; i <= n - step; i += step) {
+        cv::v_float64 dx = (cv::vx_load(&a.x[i]) + cv::vx_load(&a.width[i]) / two)
+                         - (cv::vx_load(&d.x[i]) + cv::vx_load(&d.width[i]) / two);
+        cv::v_float64 dy = (cv::vx_load(&a.y[i]) + cv::vx_load(&a.height[i]) / two)
+                         - (cv::vx_load(&d.y[i]) + cv::vx_load(&d.height[i]) / two);
+        cv::v_store(out + i, cv::v_sqrt(dx * dx + dy * dy));
+    }
+    cv::vx_cleanup();
+#endif
+
+    for (; i < n; i++) {
+        out[i] = centre_error(a.at(i), d.at(i));
+    }
+}
+
+#endif
@@ -0,0 +1,145 @@
+/* lut_kernels.h
+ *
+ * Row kernels applying a 256-entry table to 8-bit values, dst[i] = lut[src[i]].
+ * They only depend on the compiler, the selection of the kernel for the CPU
+ * the program runs on is done in img_corr.h.
+ *
+ *   lut_row_scalar : reference implementation, any CPU
+ *   lut_row_ssse3  : x86, pshufb over the 16 chunks of 16 entries of the table
+ *   lut_row_avx2   : x86, same with 32 bytes per step
+ *   lut_row_neon   : aarch64, tbl over the 4 chunks of 64 entries of the table
+ *
+ * The x86 kernels are compiled with a target attribute, so the program itself
+ * does not need to be built with -mssse3 / -mavx2; they must only be called
+ * when the CPU supports them.  Every kernel reads a block before writing it,
+ * so src == dst (in-place) is allowed.
+ */
+
+#ifndef LUT_KERNELS_H
+#define LUT_KERNELS_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LUT_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define LUT_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef unsigned char lut_uchar;
+
+inline void lut_row_scalar(const lut_uchar* src, lut_uchar* dst, int n, const lut_uchar* lut) {
+    int i = 0;
+    for (; i <= n - 4; i += 4) {
+        lut_uchar t0 = lut[src[i]], t1 = lut[src[i+1]];
+        lut_uchar t2 = lut[src[i+2]], t3 = lut[src[i+3]];
+        dst[i] = t0; dst[i+1] = t1;
+        dst[i+2] = t2; dst[i+3] = t3;
+    }
+    for (; i < n; i++) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+#ifdef LUT_KERNELS_X86
+
+/*
+ * For chunk k, pshufb looks up entry (v - 16k) & 15 of the chunk.  Adding 0x70
+ * with unsigned saturation keeps the low nibble of the values of the chunk
+ * (0..15 -> 0x70..0x7F) and sets bit 7 for all the others, which pshufb turns
+ * into 0, so OR-ing the 16 lookups gives the table value.
+ */
+
+__attribute__((target("ssse3")))
+inline void lut_row_ssse3(const lut_uchar* src, lut_uchar* dst, int n, const lut_uchar* lut) {
+    __m128i table[16];
+    for (int k = 0; k < 16; k++) {
+        table[k] = _mm_loadu_si128((const __m128i*) (lut + 16*k));
+    }
+    const __m128i step = _mm_set1_epi8(16);
+    const __m128i bias = _mm_set1_epi8(0x70);
+
+    // two independent blocks per step to hide the latency of the chains
+    int i = 0;
+    for (; i <= n - 32; i += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i*) (src + i + 16));
+        __m128i r0 = _mm_setzero_si128();
+        __m128i r1 = _mm_setzero_si128();
+        for (int k = 0; k < 16; k++) {
+            r0 = _mm_or_si128(r0, _mm_shuffle_epi8(table[k], _mm_adds_epu8(v0, bias)));
+            r1 = _mm_or_si128(r1, _mm_shuffle_epi8(table[k], _mm_adds_epu8(v1, bias)));
+            v0 = _mm_sub_epi8(v0, step);
+            v1 = _mm_sub_epi8(v1, step);
+        }
+        _mm_storeu_si128((__m128i*) (dst + i), r0);
+        _mm_storeu_si128((__m128i*) (dst + i + 16), r1);
+    }
+    lut_row_scalar(src + i, dst + i, n - i, lut);
+}
+
+__attribute__((target("avx2")))
+inline void lut_row_avx2(const lut_uchar* src, lut_uchar* dst, int n, const lut_uchar* lut) {
+    // vpshufb works within each 128-bit lane, so each chunk is in both lanes
+    __m256i table[16];
+    for (int k = 0; k < 16; k++) {
+        table[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (lut + 16*k)));
+    }
+    const __m256i step = _mm256_set1_epi8(16);
+    const __m256i bias = _mm256_set1_epi8(0x70);
+
+    int i = 0;
+    for (; i <= n - 64; i += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*) (src + i + 32));
+        __m256i r0 = _mm256_setzero_si256();
+        __m256i r1 = _mm256_setzero_si256();
+        for (int k = 0; k < 16; k++) {
+            r0 = _mm256_or_si256(r0, _mm256_shuffle_epi8(table[k], _mm256_adds_epu8(v0, bias)));
+            r1 = _mm256_or_si256(r1, _mm256_shuffle_epi8(table[k], _mm256_adds_epu8(v1, bias)));
+            v0 = _mm256_sub_epi8(v0, step);
+            v1 = _mm256_sub_epi8(v1, step);
+        }
+        _mm256_storeu_si256((__m256i*) (dst + i), r0);
+        _mm256_storeu_si256((__m256i*) (dst + i + 32), r1);
+    }
+    lut_row_scalar(src + i, dst + i, n - i, lut);
+}
+
+#endif
+
+#ifdef LUT_KERNELS_NEON
+
+/*
+ * tbl with 4 registers covers 64 entries and gives 0 for an index above 63,
+ * v - 64k wraps the values below the chunk above 191, so OR-ing the 4 lookups
+ * gives the table value.
+ */
+
+inline void lut_row_neon(const lut_uchar* src, lut_uchar* dst, int n, const lut_uchar* lut) {
+    uint8x16x4_t table[4];
+    for (int k = 0; k < 4; k++) {
+        for (int j = 0; j < 4; j++) {
+            table[k].val[j] = vld1q_u8(lut + 64*k + 16*j);
+        }
+    }
+    const uint8x16_t step = vdupq_n_u8(64);
+
+    int i = 0;
+    for (; i <= n - 16; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x16_t r = vqtbl4q_u8(table[0], v);
+        for (int k = 1; k < 4; k++) {
+            v = vsubq_u8(v, step);
+            r = vorrq_u8(r, vqtbl4q_u8(table[k], v));
+        }
+        vst1q_u8(dst + i, r);
+    }
+    lut_row_scalar(src + i, dst + i, n - i, lut);
+}
+
+#endif
+
+#endif
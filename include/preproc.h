@@ -0,0 +1,393 @@
+/* preproc.h
+ *
+ * Frame preprocessing between the capture and the tracker, replacing the
+ * offline correction pass of vid_corr.cpp for the live loops.
+ *
+ * A Preproc is a chain of stages built from a spec string, with the same
+ * parameter syntax as the eval.cpp perturbations:
+ *
+ *   gamma=G          gamma correction
+ *   bc=ALPHA:BETA    brightness / contrast
+ *   denoise=K        median filter of aperture K (3 or 5)
+ *   downscale=F      resize to 1/F of the size (area interpolation)
+ *   auto[=STEP]      adaptive gamma and contrast, see auto_exposure.h
+ *
+ * e.g. "gamma=0.7,bc=1.2:10,downscale=2".  The items of both are read by
+ * parse_spec_item.  Adjacent per-pixel stages (gamma,
+ * bc) are fused into a single table, applied in one pass over the frame; a bc
+ * stage on its own uses the fixed-point path of apply_bc instead.  The
+ * intermediate images live in buffers kept from one frame to the next, so no
+ * allocation happens once the first frame has been processed.
+ *
+ * When the tracker only looks around the target, the chain can be restricted
+ * to a window (expand_roi of the tracker box or Kalman prediction): either
+ * into a reusable ROI buffer (process_roi), or in-place within the frame for
+ * chains keeping the size (process_window), so the tracker keeps the full frame
+ * coordinates.  The cost is then proportional to the window area.
+ */
+
+#ifndef PREPROC_H
+#define PREPROC_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "img_corr.h"
+#include "auto_exposure.h"
+
+// one "key", "key=A" or "key=A:B" item of a preprocessing or perturbation spec
+struct SpecItem {
+    std::string key;
+    bool has_value;     // false for a bare key
+    bool has_b;         // the value has a second number after a colon
+    double a;
+    double b;           // 0 without a second number
+};
+
+// the whole of [begin, end) is a finite number
+inline bool parse_spec_number(const char* begin, const char* end, double& v) {
+    if (begin == end) {
+        return false;
+    }
+    std::string text(begin, end);
+    char* stop;
+    errno = 0;
+    v = std::strtod(text.c_str(), &stop);
+    return stop == text.c_str() + text.size() && errno != ERANGE && std::isfinite(v);
+}
+
+// false if the item has an '=' without a well-formed value
+inline bool parse_spec_item(const std::string& item, SpecItem& out) {
+    size_t eq = item.find('=');
+    out.key = item.substr(0, eq);
+    out.has_value = eq != std::string::npos;
+    out.has_b = false;
+    out.a = out.b = 0.0;
+    if (!out.has_value) {
+        return !out.key.empty();
+    }
+    const char* val = item.c_str() + eq + 1;
+    const char* end = item.c_str() + item.size();
+    const char* colon = std::find(val, end, ':');
+    if (colon != end) {
+        out.has_b = true;
+        if (!parse_spec_number(colon + 1, end, out.b)) {
+            return false;
+        }
+    }
+    return parse_spec_number(val, colon, out.a);
+}
+
+// the single value of item as an integer in [lo, hi]
+inline bool spec_int(const SpecItem& item, int lo, int hi, int& v) {
+    if (!item.has_value || item.has_b || item.a < lo || item.a > hi || item.a != std::floor(item.a)) {
+        return false;
+    }
+    v = (int) item.a;
+    return true;
+}
+
+// the single value of item as an odd kernel size, even sizes are rounded up
+inline bool spec_ksize(const SpecItem& item, int& ksize) {
+    if (!spec_int(item, 1, 999, ksize)) {
+        return false;
+    }
+    ksize |= 1;
+    return true;
+}
+
+class PreprocStage {
+public:
+    virtual ~PreprocStage() {}
+
+    virtual std::string name() const = 0;
+
+    // per-pixel stages give their 256-entry table, so they can be fused
+    virtual bool lut(cv::Mat& table) const { return false; }
+
+    // dst is never src, except for stages with a table (applied in-place)
+    virtual void apply(const cv::Mat& src, cv::Mat& dst) const = 0;
+
+    virtual cv::Size output_size(const cv::Size& in) const { return in; }
+};
+
+class GammaStage : public PreprocStage {
+public:
+    explicit GammaStage(double gamma) : gamma(gamma) {}
+    std::string name() const { return "gamma=" + std::to_string(gamma); }
+    bool lut(cv::Mat& table) const { table = gamma_lut(gamma); return true; }
+    void apply(const cv::Mat& src, cv::Mat& dst) const { apply_lut(src, gamma_lut(gamma), dst); }
+private:
+    double gamma;
+};
+
+class BCStage : public PreprocStage {
+public:
+    BCStage(double alpha, double beta) : alpha(alpha), beta(beta) {}
+    std::string name() const { return "bc=" + std::to_string(alpha) + ":" + std::to_string(beta); }
+    bool lut(cv::Mat& table) const { table = bc_lut(alpha, beta); return true; }
+    void apply(const cv::Mat& src, cv::Mat& dst) const { apply_bc(src, alpha, beta, dst); }
+private:
+    double alpha;
+    double beta;
+};
+
+class DenoiseStage : public PreprocStage {
+public:
+    explicit DenoiseStage(int ksize) : ksize(ksize) {}
+    std::string name() const { return "denoise=" + std::to_string(ksize); }
+    void apply(const cv::Mat& src, cv::Mat& dst) const { cv::medianBlur(src, dst, ksize); }
+private:
+    int ksize;
+};
+
+class DownscaleStage : public PreprocStage {
+public:
+    explicit DownscaleStage(double factor) : factor(factor) {}
+    std::string name() const { return "downscale=" + std::to_string(factor); }
+    void apply(const cv::Mat& src, cv::Mat& dst) const {
+        cv::resize(src, dst, output_size(src.size()), 0, 0, cv::INTER_AREA);
+    }
+    cv::Size output_size(const cv::Size& in) const {
+        return cv::Size(std::max(1, cvRound(in.width / factor)), std::max(1, cvRound(in.height / factor)));
+    }
+private:
+    double factor;
+};
+
+// its table follows the footage, so it is a pass of its own
+class AutoExposureStage : public PreprocStage {
+public:
+    explicit AutoExposureStage(int step) : step(step), exposure(step) {}
+    std::string name() const { return "auto=" + std::to_string(step); }
+    void apply(const cv::Mat& src, cv::Mat& dst) const {
+        exposure.update(src);
+        exposure.apply(src, dst);
+    }
+private:
+    int step;
+    mutable AutoExposure exposure;
+};
+
+// box grown by margin times its size on each side, clipped to the frame
+inline cv::Rect expand_roi(const cv::Rect2d& box, double margin, const cv::Size& frame) {
+    cv::Rect2d grown(box.x - margin * box.width, box.y - margin * box.height,
+                     box.width * (1 + 2 * margin), box.height * (1 + 2 * margin));
+    cv::Rect roi(cvFloor(grown.x), cvFloor(grown.y), cvCeil(grown.width) + 1, cvCeil(grown.height) + 1);
+    return roi & cv::Rect(cv::Point(0, 0), frame);
+}
+
+class Preproc {
+public:
+
+    Preproc() {}
+
+    // false if the spec is malformed, the stages read so far are kept
+    bool parse(const std::string& spec) {
+        size_t start = 0;
+        while (start < spec.size()) {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            SpecItem item;
+            if (!parse_spec_item(spec.substr(start, end - start), item)) {
+                return false;
+            }
+            start = end + 1;
+
+            if (item.key == "auto" && !item.has_value) {
+                add(cv::makePtr<AutoExposureStage>(4));
+                continue;
+            }
+            if (!item.has_value || (item.has_b && item.key != "bc")) {
+                return false;
+            }
+
+            int n;
+            if (item.key == "gamma") {
+                add(cv::makePtr<GammaStage>(item.a));
+            }
+            else if (item.key == "bc") {
+                add(cv::makePtr<BCStage>(item.a, item.b));
+            }
+            else if (item.key == "auto") {
+                if (!spec_int(item, 1, 64, n)) {
+                    return false;
+                }
+                add(cv::makePtr<AutoExposureStage>(n));
+            }
+            else if (item.key == "denoise") {
+                if (!spec_ksize(item, n)) {
+                    return false;
+                }
+                add(cv::makePtr<DenoiseStage>(n));
+            }
+            else if (item.key == "downscale") {
+                if (item.a <= 0) {
+                    return false;
+                }
+                add(cv::makePtr<DownscaleStage>(item.a));
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void add(const cv::Ptr<PreprocStage>& stage) {
+        stages.push_back(stage);
+        fuse();
+    }
+
+    bool empty() const {
+        return stages.empty();
+    }
+
+    // size of the processed frames for input frames of size in
+    cv::Size output_size(const cv::Size& in) const {
+        cv::Size size = in;
+        for (size_t i = 0; i < stages.size(); i++) {
+            size = stages[i]->output_size(size);
+        }
+        return size;
+    }
+
+    std::string describe() const {
+        std::string desc;
+        for (size_t i = 0; i < stages.size(); i++) {
+            desc += (i ? ", " : "") + stages[i]->name();
+        }
+        return desc.empty() ? "none" : desc;
+    }
+
+    // true if the processed frames have the size of the input, i.e. no downscale
+    bool preserves_size() const {
+        cv::Size probe(640, 480);
+        return output_size(probe) == probe;
+    }
+
+    // number of passes over the frame once the per-pixel stages are fused
+    size_t passes() const {
+        return steps.size();
+    }
+
+    void process(const cv::Mat& src, cv::Mat& dst) {
+    /*
+     * Run the chain on src into dst, which may be src.  The last pass writes
+     * directly into dst, the others into the pooled buffers.
+     */
+        if (steps.empty()) {
+            if (dst.data != src.data) {
+                src.copyTo(dst);
+            }
+            return;
+        }
+
+        const cv::Mat* cur = &src;
+        for (size_t i = 0; i < steps.size(); i++) {
+            const Step& step = steps[i];
+            bool last = i + 1 == steps.size();
+
+            // the per-pixel steps work in-place, the other stages need distinct images
+            if (last && (!step.table.empty() || dst.data != cur->data)) {
+                run(step, *cur, dst);
+                return;
+            }
+
+            cv::Size out_size = step.table.empty() ? step.stage->output_size(cur->size()) : cur->size();
+            cv::Mat& buf = pooled(backing[i % 2], pool[i % 2], out_size, cur->type());
+            run(step, *cur, buf);
+            if (last) {
+                buf.copyTo(dst);
+            }
+            cur = &buf;
+        }
+    }
+
+    // process the window roi of src only, returns the window clipped to src.
+    // roi_buf is a view of a buffer kept across frames, valid until the next call.
+    cv::Rect process_roi(const cv::Mat& src, const cv::Rect& roi, cv::Mat& roi_buf) {
+        cv::Rect clipped = roi & cv::Rect(cv::Point(0, 0), src.size());
+        if (clipped.empty()) {
+            roi_buf.release();
+            return clipped;
+        }
+        cv::Mat window = src(clipped);
+        pooled(roi_backing, roi_buf, output_size(clipped.size()), src.type());
+        process(window, roi_buf);
+        return clipped;
+    }
+
+    // process the window roi of frame in-place, the rest of the frame is left as is
+    cv::Rect process_window(cv::Mat& frame, const cv::Rect& roi) {
+        CV_Assert(preserves_size());
+        cv::Rect clipped = roi & cv::Rect(cv::Point(0, 0), frame.size());
+        if (!clipped.empty()) {
+            cv::Mat window = frame(clipped);
+            process(window, window);
+        }
+        return clipped;
+    }
+
+private:
+
+    struct Step {
+        cv::Ptr<PreprocStage> stage;    // single stage, possibly with a faster path than its table
+        cv::Mat table;                  // table of the per-pixel stages, composed when fused
+    };
+
+    static void run(const Step& step, const cv::Mat& src, cv::Mat& dst) {
+        if (!step.stage.empty()) {
+            step.stage->apply(src, dst);
+        }
+        else {
+            apply_lut(src, step.table, dst);
+        }
+    }
+
+    // rebuild the passes, the tables of adjacent stages are composed.  A step
+    // keeps its stage only when it has no table or is a bc stage on its own
+    // (apply_bc), the other tables are applied as computed here, not per frame
+    void fuse() {
+        steps.clear();
+        for (size_t i = 0; i < stages.size(); i++) {
+            Step step;
+            step.stage = stages[i];
+            bool has_lut = stages[i]->lut(step.table);
+            if (has_lut && !steps.empty() && !steps.back().table.empty()) {
+                steps.back().table = compose_lut(steps.back().table, step.table);
+                steps.back().stage.release();
+                continue;
+            }
+            if (has_lut && !dynamic_cast<BCStage*>(stages[i].get())) {
+                step.stage.release();
+            }
+            steps.push_back(step);
+        }
+    }
+
+    // view of size on a buffer only ever grown, so that windows of varying
+    // size do not reallocate: create() on the view is then a no-op
+    static cv::Mat& pooled(cv::Mat& buffer, cv::Mat& view, const cv::Size& size, int type) {
+        if (buffer.type() != type || buffer.cols < size.width || buffer.rows < size.height) {
+            buffer.create(std::max(size.height, buffer.rows), std::max(size.width, buffer.cols), type);
+        }
+        view = buffer(cv::Rect(cv::Point(0, 0), size));
+        return view;
+    }
+
+    std::vector<cv::Ptr<PreprocStage> > stages;
+    std::vector<Step> steps;
+    cv::Mat backing[2];
+    cv::Mat pool[2];
+    cv::Mat roi_backing;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/* tracker_factory.h
+ *
+ * Create an OpenCV tracker from its name.  Both the short names used by the
+ * C++ tools (Boosting, MF) and the names used by the Python scripts in test/
+ * (BOOSTING, MEDIANFLOW) are accepted.  An empty Ptr is returned for an
+ * unknown name.
+ */
+
+#ifndef TRACKER_FACTORY_H
+#define TRACKER_FACTORY_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/tracking.hpp>
+#include <string>
+
+inline cv::Ptr<cv::Tracker> createTrackerType(const std::string& trackername) {
+    // create tracker according to the trackername specified
+
+    cv::Ptr<cv::Tracker> tracker;
+    if (trackername == "MIL") {
+        tracker = cv::TrackerMIL::create();
+    }
+    if (trackername == "Boosting" || trackername == "BOOSTING") {
+        tracker = cv::TrackerBoosting::create();
+    }
+    if (trackername == "KCF") {
+        tracker = cv::TrackerKCF::create();
+    }
+    if (trackername == "TLD") {
+        tracker = cv::TrackerTLD::create();
+    }
+    if (trackername == "MOSSE") {
+        tracker = cv::TrackerMOSSE::create();
+    }
+    if (trackername == "CSRT") {
+        tracker = cv::TrackerCSRT::create();
+    }
+    if (trackername == "MF" || trackername == "MEDIANFLOW") {
+        tracker = cv::TrackerMedianFlow::create();
+    }
+
+    return tracker;
+}
+
+#endif
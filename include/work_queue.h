@@ -0,0 +1,228 @@
+/* work_queue.h
+ *
+ * Work queue in a plain directory, for evaluation sweeps sharded over several
+ * worker processes, on one machine or on several machines sharing the
+ * filesystem.  No server is involved, every transition of an item is a
+ * rename(), which is atomic within one filesystem:
+ *
+ *   DIR/todo/ID.job                 item waiting for a worker
+ *   DIR/claimed/ID.job@HOST@PID     item being processed by worker PID on HOST
+ *   DIR/done/ID.res                 result of the item
+ *   DIR/failed/ID.job               item whose inputs could not be loaded
+ *
+ * Files are written under a temporary name and renamed once complete, so a
+ * crash never leaves a half written item or result behind.  After a crash,
+ * queue_recover() puts back the claims of dead workers and re-running the
+ * coordinator only adds the items that are not already known, and the failed
+ * ones again.
+ */
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+inline std::string queue_hostname() {
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host);
+}
+
+inline bool queue_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// names of the entries of a directory, sorted, "." files (temporary) excluded
+inline std::vector<std::string> queue_list(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return names;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != 0) {
+        if (e->d_name[0] != '.') {
+            names.push_back(e->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+inline bool queue_read(const std::string& path, std::string& content) {
+    std::ifstream fp(path.c_str(), std::ios::binary);
+    if (!fp) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << fp.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+// write to a temporary name in the same directory, then rename into place
+inline bool queue_write(const std::string& dir, const std::string& name, const std::string& content) {
+    std::ostringstream tmp;
+    tmp << dir << "/." << name << "." << queue_hostname() << "." << getpid();
+    {
+        std::ofstream fp(tmp.str().c_str(), std::ios::binary);
+        if (!fp) {
+            return false;
+        }
+        fp << content;
+        if (!fp.flush()) {
+            return false;
+        }
+    }
+    return rename(tmp.str().c_str(), (dir + "/" + name).c_str()) == 0;
+}
+
+inline bool queue_init(const std::string& dir) {
+    mkdir(dir.c_str(), 0775);
+    mkdir((dir + "/todo").c_str(), 0775);
+    mkdir((dir + "/claimed").c_str(), 0775);
+    mkdir((dir + "/done").c_str(), 0775);
+    mkdir((dir + "/failed").c_str(), 0775);
+    return queue_exists(dir + "/todo") && queue_exists(dir + "/claimed") && queue_exists(dir + "/done")
+        && queue_exists(dir + "/failed");
+}
+
+// true if the item was added or a failed item put back, false if it is already
+// queued, claimed or done
+inline bool queue_push(const std::string& dir, const std::string& id, const std::string& payload) {
+    if (rename((dir + "/failed/" + id + ".job").c_str(), (dir + "/todo/" + id + ".job").c_str()) == 0) {
+        return true;
+    }
+    if (queue_exists(dir + "/todo/" + id + ".job") || queue_exists(dir + "/done/" + id + ".res")) {
+        return false;
+    }
+    std::vector<std::string> claimed = queue_list(dir + "/claimed");
+    for (size_t i = 0; i < claimed.size(); i++) {
+        if (claimed[i].compare(0, id.size() + 5, id + ".job@") == 0) {
+            return false;
+        }
+    }
+    return queue_write(dir + "/todo", id + ".job", payload);
+}
+
+// claim one item, the first worker to rename it owns it
+inline bool queue_claim(const std::string& dir, std::string& id, std::string& payload) {
+    std::ostringstream owner;
+    owner << "@" << queue_hostname() << "@" << getpid();
+
+    std::vector<std::string> todo = queue_list(dir + "/todo");
+    for (size_t i = 0; i < todo.size(); i++) {
+        const std::string& name = todo[i];
+        if (name.size() < 5 || name.compare(name.size() - 4, 4, ".job") != 0) {
+            continue;
+        }
+        std::string claim = dir + "/claimed/" + name + owner.str();
+        if (rename((dir + "/todo/" + name).c_str(), claim.c_str()) != 0) {
+            continue;   // someone else was faster
+        }
+        // the claim time is what queue_recover() ages for the other hosts
+        utime(claim.c_str(), 0);
+        id = name.substr(0, name.size() - 4);
+        if (queue_read(claim, payload)) {
+            return true;
+        }
+        // release it, another worker (or a later call) may be able to read it
+        rename(claim.c_str(), (dir + "/todo/" + name).c_str());
+    }
+    return false;
+}
+
+inline bool queue_complete(const std::string& dir, const std::string& id, const std::string& result) {
+    if (!queue_write(dir + "/done", id + ".res", result)) {
+        return false;
+    }
+    std::ostringstream claim;
+    claim << dir << "/claimed/" << id << ".job@" << queue_hostname() << "@" << getpid();
+    unlink(claim.str().c_str());
+    return true;
+}
+
+// give up an item claimed by this worker, queue_push() puts it back in todo
+inline bool queue_fail(const std::string& dir, const std::string& id) {
+    std::ostringstream claim;
+    claim << dir << "/claimed/" << id << ".job@" << queue_hostname() << "@" << getpid();
+    return rename(claim.str().c_str(), (dir + "/failed/" + id + ".job").c_str()) == 0;
+}
+
+// put back the claims of workers that died, returns the number of items requeued.
+// Local claims are checked with the pid, claims of other hosts by their age, so
+// stale_seconds has to be longer than the longest item.
+inline int queue_recover(const std::string& dir, double stale_seconds) {
+    const std::string host = queue_hostname();
+    std::vector<std::string> claimed = queue_list(dir + "/claimed");
+    int requeued = 0;
+
+    for (size_t i = 0; i < claimed.size(); i++) {
+        const std::string& name = claimed[i];
+        size_t at1 = name.find('@');
+        size_t at2 = name.rfind('@');
+        if (at1 == std::string::npos || at1 == at2) {
+            continue;
+        }
+        std::string job = name.substr(0, at1);
+        std::string id = job.substr(0, job.size() - 4);
+        std::string owner_host = name.substr(at1 + 1, at2 - at1 - 1);
+        pid_t pid = (pid_t) atol(name.substr(at2 + 1).c_str());
+        std::string path = dir + "/claimed/" + name;
+
+        bool dead;
+        if (owner_host == host) {
+            dead = kill(pid, 0) != 0 && errno == ESRCH;
+        }
+        else {
+            struct stat st;
+            dead = stat(path.c_str(), &st) == 0 && difftime(time(0), st.st_mtime) > stale_seconds;
+        }
+        if (!dead) {
+            continue;
+        }
+
+        if (queue_exists(dir + "/done/" + id + ".res")) {
+            unlink(path.c_str());
+        }
+        else if (rename(path.c_str(), (dir + "/todo/" + job).c_str()) == 0) {
+            requeued++;
+        }
+    }
+    return requeued;
+}
+
+// ids of all finished items with their result, in id order
+inline std::vector<std::pair<std::string, std::string> > queue_results(const std::string& dir) {
+    std::vector<std::pair<std::string, std::string> > results;
+    std::vector<std::string> done = queue_list(dir + "/done");
+    for (size_t i = 0; i < done.size(); i++) {
+        const std::string& name = done[i];
+        if (name.size() < 5 || name.compare(name.size() - 4, 4, ".res") != 0) {
+            continue;
+        }
+        std::string content;
+        if (queue_read(dir + "/done/" + name, content)) {
+            results.push_back(std::make_pair(name.substr(0, name.size() - 4), content));
+        }
+    }
+    return results;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/* annot_conv.cpp
+ *
+ * Convert bounding box annotations between the text format written by
+ * select.cpp and the compact binary format of include/annot_io.h.
+ * The input format is detected from the file content, the output format
+ * from the extension of the output file (".bin" for binary, text otherwise).
+ *
+ * usage: ./annot_conv INPUT OUTPUT
+ * example: $ ./annot_conv runner1.mp4.txt runner1.bin
+ *          $ ./annot_conv runner1.bin runner1.txt
+ */
+
+
+#include "opencv2/core.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/annot_io.h"
+
+
+using namespace std;
+using namespace cv;
+
+
+static bool has_extension(const string& fname, const string& ext) {
+    return fname.size() >= ext.size() &&
+           fname.compare(fname.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+int main(int argc, char ** argv) {
+
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " INPUT OUTPUT" << endl;
+        return 1;
+    }
+
+    string infname = argv[1];
+    string outfname = argv[2];
+
+    vector<Rect2d> bounds = read_box(infname);
+    if (bounds.empty()) {
+        cerr << "No annotation read from " << infname << endl;
+        return 1;
+    }
+
+    if (has_extension(outfname, ".bin")) {
+        save_box_bin(bounds, outfname);
+    }
+    else {
+        save_box(bounds, outfname);
+    }
+
+    cout << bounds.size() << " boxes written to " << outfname << endl;
+    return 0;
+}
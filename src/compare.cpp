@@ -0,0 +1,137 @@
+/* compare.cpp
+ *
+ * Native replacement of test/runtest.sh + test/test.py: compare the OpenCV
+ * trackers on one video, headless.  The video is decoded once and every frame
+ * is handed to all the trackers, which are updated in parallel.  Only the
+ * update() calls are timed, so the runtime does not include any GUI overhead.
+ * As the trackers share the cores, give a single tracker to time it alone.
+ *
+ * usage: ./compare VIDEO INITBOX [TRACKER ...]
+ *   INITBOX : "(x,y,w,h)" as printed by test/selectbbox.py,
+ *             or an annotation file whose first box is used
+ *   TRACKER : default BOOSTING MIL KCF TLD MEDIANFLOW MOSSE CSRT, as runtest.sh
+ *
+ * example: $ ./compare ../test/samples/runner1.mp4 `python ../test/selectbbox.py ../test/samples/runner1.mp4`
+ */
+
+
+#include "opencv2/core.hpp"
+#include "opencv2/video.hpp"
+#include "opencv2/tracking.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../include/annot_io.h"
+#include "../include/tracker_factory.h"
+
+
+using namespace std;
+using namespace cv;
+
+
+static bool parseInitBox(const string& arg, Rect2d& initbbox) {
+/*
+ * Initial box from the selectbbox.py output, or first box of an annotation file
+ */
+    double x, y, w, h;
+    if (sscanf(arg.c_str(), "(%lf,%lf,%lf,%lf)", &x, &y, &w, &h) == 4) {
+        initbbox = Rect2d(x, y, w, h);
+        return true;
+    }
+
+    vector<Rect2d> bounds = read_box(arg);
+    if (bounds.empty()) {
+        return false;
+    }
+    initbbox = bounds.at(0);
+    return true;
+}
+
+// latency percentile in ms, lat is sorted
+static double percentile(const vector<double>& lat, double p) {
+    if (lat.empty()) {
+        return 0.0;
+    }
+    size_t k = (size_t) (p / 100.0 * (lat.size() - 1) + 0.5);
+    return lat[min(k, lat.size() - 1)];
+}
+
+int main(int argc, char ** argv) {
+
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " VIDEO INITBOX [TRACKER ...]" << endl;
+        return 1;
+    }
+
+    Rect2d initbbox;
+    if (!parseInitBox(argv[2], initbbox)) {
+        cerr << "Could not read the initial box from " << argv[2] << endl;
+        return 1;
+    }
+
+    vector<string> names(argv + 3, argv + argc);
+    if (names.empty()) {
+        const char* defaults[] = { "BOOSTING", "MIL", "KCF", "TLD", "MEDIANFLOW", "MOSSE", "CSRT" };
+        names.assign(defaults, defaults + 7);
+    }
+
+    vector<Ptr<Tracker> > trackers;
+    for (size_t t = 0; t < names.size(); t++) {
+        trackers.push_back(createTrackerType(names[t]));
+        if (trackers.back().empty()) {
+            cerr << "Unknown tracker " << names[t] << endl;
+            return 1;
+        }
+    }
+
+    VideoCapture video;
+    video.open(argv[1]);
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video." << endl;
+        return 1;
+    }
+
+    const int n_trackers = (int) trackers.size();
+    vector<Rect2d> trackingbox(n_trackers, initbbox);
+    vector<int> failures(n_trackers, 0);
+    vector<vector<double> > latency(n_trackers);
+    Mat frame;
+
+    for (int i = 0; video.read(frame); i++) {
+        parallel_for_(Range(0, n_trackers), [&](const Range& range) {
+            for (int t = range.start; t < range.end; t++) {
+                if (i == 0) {
+                    trackers[t]->init(frame, initbbox);
+                    continue;
+                }
+                int64 start = getTickCount();
+                bool ok = trackers[t]->update(frame, trackingbox[t]);
+                latency[t].push_back(1000.0 * (getTickCount() - start) / getTickFrequency());
+                if (!ok) {
+                    failures[t]++;
+                }
+            }
+        }, n_trackers);
+    }
+
+    // same summary line as test.py, followed by the latency distribution
+    for (int t = 0; t < n_trackers; t++) {
+        vector<double>& lat = latency[t];
+        double runtime = 0.0;
+        for (size_t k = 0; k < lat.size(); k++) {
+            runtime += lat[k];
+        }
+        sort(lat.begin(), lat.end());
+
+        cout << names[t] << " algorithm: " << failures[t] << " failed loops, runtime = "
+             << runtime / 1000.0
+             << ", latency ms p50 = " << percentile(lat, 50)
+             << " p90 = " << percentile(lat, 90)
+             << " p99 = " << percentile(lat, 99)
+             << " max = " << (lat.empty() ? 0.0 : lat.back()) << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/* corr_bench.cpp
+ *
+ * Check and benchmark of the table correction of include/img_corr.h.
+ * Every row kernel available on this CPU (scalar, ssse3, avx2, neon) is
+ * checked to give byte-identical output to cv::LUT, out-of-place, in-place and
+ * on a non-continuous ROI, for row lengths hitting all the loop tails.  Then
+ * each path is timed on a frame, on one thread and with the row stripes in
+ * parallel.  The fixed-point brightness / contrast kernels are checked to stay
+ * within 1 of the double computation for all the representable parameters of
+ * a grid, and timed against it and the table.  Finally a preprocessing chain is
+ * timed on the whole frame and on a window around a target, as done by the
+ * trackers.
+ *
+ * usage: ./corr_bench [width height]
+ * example: $ ./corr_bench 3840 2160
+ */
+
+
+#include "opencv2/core.hpp"
+#include <iostream>
+#include <vector>
+#include "../include/img_corr.h"
+#include "../include/preproc.h"
+
+
+using namespace std;
+using namespace cv;
+
+
+static double elapsed_ms(int64 start) {
+    return 1000.0 * (getTickCount() - start) / getTickFrequency();
+}
+
+static bool same_bytes(const Mat& a, const Mat& b) {
+    return a.size() == b.size() && a.type() == b.type() && norm(a, b, NORM_INF) == 0;
+}
+
+static bool check_path(int path, RNG& rng) {
+    const int widths[] = { 1, 5, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 641, 1920 };
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        for (int cn = 1; cn <= 3; cn += 2) {
+            Mat lut(1, 256, CV_8U);
+            rng.fill(lut, RNG::UNIFORM, 0, 256);
+            Mat src(7, widths[w], CV_8UC(cn));
+            rng.fill(src, RNG::UNIFORM, 0, 256);
+
+            Mat ref, dst;
+            LUT(src, lut, ref);
+            apply_lut(src, lut, dst, path);
+
+            Mat inplace = src.clone();
+            apply_lut(inplace, lut, inplace, path);
+
+            // ROI inside a larger image, the rows are not contiguous
+            Mat big(src.rows + 2, src.cols + 3, src.type(), Scalar::all(0));
+            Mat roi = big(Rect(1, 1, src.cols, src.rows));
+            src.copyTo(roi);
+            apply_lut(roi, lut, roi, path);
+
+            if (!same_bytes(ref, dst) || !same_bytes(ref, inplace) || !same_bytes(ref, roi)) {
+                cout << lut_path_name(path) << ": MISMATCH for width " << widths[w]
+                     << ", " << cn << " channels" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) {
+
+    const int width = argc > 2 ? atoi(argv[1]) : 3840;
+    const int height = argc > 2 ? atoi(argv[2]) : 2160;
+    const int n_runs = 20;
+    const int n_threads = getNumThreads();
+
+    RNG rng(42);
+    Mat frame(height, width, CV_8UC3);
+    rng.fill(frame, RNG::UNIFORM, 0, 256);
+    Mat lut = gamma_bc_lut(0.7, 1.2, 10);
+    Mat out;
+
+    cout << "best path on this CPU: " << lut_path_name(lut_best_path()) << endl;
+
+    int64 start = getTickCount();
+    for (int r = 0; r < n_runs; r++) {
+        LUT(frame, lut, out);
+    }
+    cout << "cv::LUT: " << elapsed_ms(start) / n_runs << "ms" << endl;
+
+    bool ok = true;
+    for (int path = LUT_SCALAR; path <= LUT_NEON; path++) {
+        if (!lut_kernel(path)) {
+            cout << lut_path_name(path) << ": not available" << endl;
+            continue;
+        }
+        bool same = check_path(path, rng);
+        ok = ok && same;
+
+        setNumThreads(1);
+        start = getTickCount();
+        for (int r = 0; r < n_runs; r++) {
+            apply_lut(frame, lut, out, path);
+        }
+        double single_ms = elapsed_ms(start) / n_runs;
+
+        setNumThreads(n_threads);
+        start = getTickCount();
+        for (int r = 0; r < n_runs; r++) {
+            apply_lut(frame, lut, out, path);
+        }
+        double parallel_ms = elapsed_ms(start) / n_runs;
+
+        cout << lut_path_name(path) << ": " << width << "x" << height
+             << ", 1 thread " << single_ms << "ms"
+             << ", " << n_threads << " threads " << parallel_ms << "ms"
+             << (same ? ", byte-identical" : ", MISMATCH") << endl;
+    }
+
+    // the former per-pixel double computation of bc_adjust
+    const double alpha = 1.2, beta = 10;
+    Mat ref(frame.size(), frame.type());
+    start = getTickCount();
+    for (int r = 0; r < n_runs / 4; r++) {
+        for (int y = 0; y < frame.rows; y++) {
+            const uchar* p = frame.ptr<uchar>(y);
+            uchar* q = ref.ptr<uchar>(y);
+            for (int x = 0; x < frame.cols * frame.channels(); x++) {
+                q[x] = saturate_cast<uchar>(alpha * p[x] + beta);
+            }
+        }
+    }
+    cout << "bc double: " << elapsed_ms(start) / (n_runs / 4) << "ms" << endl;
+
+    Mat ramp(1, 256, CV_8U), ramp_ref(1, 256, CV_8U), ramp_out;
+    for (int i = 0; i < 256; i++) {
+        ramp.at<uchar>(i) = (uchar) i;
+    }
+    for (int path = BC_TABLE; path <= BC_NEON; path++) {
+        if (path != BC_TABLE && !bc_kernel(path)) {
+            cout << bc_path_name(path) << ": not available" << endl;
+            continue;
+        }
+        int max_err = 0;
+        for (double a = 0; a < 8; a += 0.0625) {
+            for (double b = -255; b < 256; b += 7.5) {
+                for (int i = 0; i < 256; i++) {
+                    ramp_ref.at<uchar>(i) = saturate_cast<uchar>(a * i + b);
+                }
+                apply_bc(ramp, a, b, ramp_out, path);
+                max_err = max(max_err, (int) norm(ramp_out, ramp_ref, NORM_INF));
+            }
+        }
+        ok = ok && max_err <= 1;
+
+        start = getTickCount();
+        for (int r = 0; r < n_runs; r++) {
+            apply_bc(frame, alpha, beta, out, path);
+        }
+        cout << "bc " << bc_path_name(path) << ": " << elapsed_ms(start) / n_runs << "ms"
+             << ", max error " << max_err << (max_err <= 1 ? "" : ", TOO LARGE") << endl;
+    }
+
+    // 200x150 target with a margin of its size on each side
+    Preproc pre;
+    pre.parse("gamma=0.7,bc=1.2:10,denoise=3");
+    Rect window = expand_roi(Rect2d(width / 2, height / 2, 200, 150), 1.0, frame.size());
+    Mat image = frame.clone();
+
+    start = getTickCount();
+    for (int r = 0; r < n_runs; r++) {
+        pre.process(frame, out);
+    }
+    double full_ms = elapsed_ms(start) / n_runs;
+
+    start = getTickCount();
+    for (int r = 0; r < n_runs; r++) {
+        pre.process_window(image, window);
+    }
+    double window_ms = elapsed_ms(start) / n_runs;
+
+    cout << "preprocessing " << pre.describe() << " (" << pre.passes() << " passes): full frame "
+         << full_ms << "ms, window " << window.width << "x" << window.height << " " << window_ms << "ms" << endl;
+
+    return ok ? 0 : 1;
+}
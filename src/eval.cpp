@@ -12,6 +12,7 @@
 #include "opencv2/video.hpp"
 #include "opencv2/tracking.hpp"
 #include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
 #include <iostream>
 #include <sstream>
 #include <cmath>
@@ -19,53 +20,25 @@
 #include <iterator>
 #include <fstream>
 #include <ctime>
+#include <stdint.h>
 #include <unistd.h>
+#include "../include/iou.h"
+#include "../include/annot_io.h"
+#include "../include/eval_metrics.h"
+#include "../include/work_queue.h"
+#include "../include/img_corr.h"
+#include "../include/preproc.h"
+#include "../include/tracker_factory.h"
+#include <sys/wait.h>
 
 
 using namespace std;
 using namespace cv;
 
 
-static Ptr<Tracker> createTrackerType(const string trackername) {
-    // create tracker according to the trackername specified
- 
-    Ptr<Tracker> tracker;
-    if (trackername == "MIL") {
-        tracker = TrackerMIL::create();
-    }
-    if (trackername == "Boosting") {
-        tracker = TrackerBoosting::create();
-    }
-    if (trackername == "KCF") {
-        tracker = TrackerKCF::create();
-    }
-    if (trackername == "TLD") {
-        tracker = TrackerTLD::create();
-    }
-    if (trackername == "MOSSE") {
-        tracker = TrackerMOSSE::create();
-    }
-    if (trackername == "CSRT") {
-        tracker = TrackerCSRT::create();
-    }
-    if (trackername == "MF") {
-        tracker = TrackerMedianFlow::create();
-    }
-    if (trackername == "HOG"){
-        //tracker = TrackerFeature::create("HOG");
-    }
-    if (trackername == "HAAR"){
-        //tracker = TrackerFeature::create("HAAR");
-    }
-    
-    return tracker;
-}
-
 vector<double> calculateIoU(const String videoname, Ptr<Tracker> tracker,
                                      vector<Rect2d> bounds, bool unbiased) {
                             
-    double IoU_eval(Rect2d bbox_a, Rect2d bbox_d);
-    double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg);
     
     // run the calculation according to the number of evaluation selected
     VideoCapture video;
@@ -125,87 +98,599 @@ vector<double> calculateIoU(const String videoname, Ptr<Tracker> tracker,
 
 
 
-double IoU_eval(Rect2d bbox_a, Rect2d bbox_d) {
-/* calculate IoU accuracy of label bbox and prediction box */
+struct EvalCase {
+    String videoname;
+    String annotname;
+};
 
-    // bbox_a: annotation bbox, bbox_d: detection result bbox
-    Rect2d bbox_da = bbox_a & bbox_d;
-    
-    if ( bbox_da.area() == 0 ) {
-        return 0.0;
+static vector<EvalCase> read_cases(String fname) {
+/*
+ * Read the list of clips to evaluate, one "VIDEO ANNOTATION" pair per line
+ */
+    ifstream fp;
+    fp.open(fname);
+
+    vector<EvalCase> cases;
+    String line;
+    while (getline(fp,line)) {
+        istringstream ss(line);
+        EvalCase c;
+        if (ss >> c.videoname >> c.annotname) {
+            cases.push_back(c);
+        }
     }
-    
-    double A_da = (double) bbox_da.area();
-    double A_d1a = (double) bbox_a.area() - A_da;
-    double A_da1 = (double) bbox_d.area() - A_da;
-    
-    //cout << A_da << " " << A_d1a << " " << A_da1 << endl; //dmsg
-    double acc = A_da / (A_da + A_d1a + A_da1);
-    return acc;
+    fp.close();
+
+    return cases;
 }
 
-double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg) {
-/* calculate unbiased IoU accuracy of label bbox and prediction bbox 
- * According to the paper: Countering bias in tracking evaluations
- * by G. Hager et al, https://www.scitepress.org/Papers/2018/67148/67148.pdf
+bool calculateCurves(const String videoname, Ptr<Tracker> tracker,
+                     const vector<Rect2d>& bounds, TrackingCurves& curves) {
+/*
+ * Run the tracker over the video and accumulate the success / precision curves,
+ * nothing is stored per frame so the memory used does not grow with the clip.
+ * Returns false if the video or its annotation could not be read
  */
-    // bbox_a: annotation bbox, bbox_d: detection result bbox 
-    Rect2d bbox_da = bbox_a & bbox_d;
-    
-    // if they don't intersect at all => precision = 0 
-    if ( bbox_da.area() == 0 ) {
-        return 0.0;
+    VideoCapture video;
+    video.open(videoname);
+
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video: " << videoname << endl;
+        return false;
+    }
+    if ( bounds.empty() ) {
+        cerr << "(calculateCurves) No annotation for " << videoname << endl;
+        return false;
     }
-    
-    // A_d1a1 = A_bg - A_union(bbox_a, bbox_d): background area - area of union of two boxes
-    double A_da = (double) bbox_da.area();
-    double A_d1a = (double) bbox_a.area() - A_da;
-    double A_da1 = (double) bbox_d.area() - A_da;
-    double A_union_da = A_da + A_d1a + A_da1;
 
-    double A_d1a1 = A_bg - A_union_da;
-    
-    // cout << A_da << " " << A_d1a << " " << A_da1 << " " << A_d1a1 << endl; //dmsg
-    
-    // cast to double
-    double w0 = pow ((A_da + A_da1 + A_d1a),2)  / 
-                ( pow((A_da + A_da1 + A_d1a),2) + pow((A_d1a1 + A_da1 + A_d1a),2) ) ;
-                
-    double wbg = 1 - w0;
-    
-    double acc =   w0  *  A_da / (A_da + A_d1a + A_da1)  
-                 + wbg * A_d1a1 / (A_d1a1 + A_d1a + A_da1) ;
-    
-    return acc;
-    
+    size_t n_frames = (size_t) video.get(VideoCaptureProperties::CAP_PROP_FRAME_COUNT);
+    n_frames = min(n_frames, bounds.size());
+    Mat frame;
+    Rect2d trackingbox = bounds.at(0);
+
+    for (size_t i = 0; i < n_frames; ++i) {
+        bool readok = video.read(frame);
+        if (!readok) {
+            cerr << "(calculateCurves) Problem occured in reading video frames\n";
+            break;
+        }
+        if (i == 0) {
+            tracker->init(frame, bounds.at(0));
+            continue;
+        }
+
+        const Rect2d& annotbox = bounds.at(i);
+        bool trackok = tracker->update(frame, trackingbox);
+        // the unannotated frames are tracked through but left out of the curves
+        if (annotbox.area() <= 0) {
+            continue;
+        }
+        if (trackok) {
+            curves.add(annotbox, trackingbox, IoU_eval(annotbox, trackingbox));
+        }
+        else {
+            curves.add_failure();
+        }
+    }
+    return true;
 }
 
-vector<Rect2d> read_box(String fname) {
+vector<TrackingCurves> evaluateCurves(const vector<EvalCase>& cases,
+                                      const vector<string>& trackers) {
 /*
- * Read the saved file (txt) into a list of Rect2d
- */ 
- 
-    ifstream fp;
-    fp.open(fname);
-    
-    vector<String> saved_box;
-    
-    String line;
-    while (getline(fp,line)) {
-        saved_box.push_back(line);
-    }    
-    fp.close();
+ * Evaluate every tracker on every clip in parallel, one job per (tracker, clip)
+ * pair, and merge the curves of each tracker over all the clips
+ */
+    vector<vector<Rect2d> > annots(cases.size());
+    for (size_t c = 0; c < cases.size(); c++) {
+        annots[c] = read_box(cases[c].annotname);
+    }
+
+    const int n_cases = (int) cases.size();
+    const int n_jobs = (int) trackers.size() * n_cases;
+    vector<TrackingCurves> jobs(n_jobs);
+
+    parallel_for_(Range(0, n_jobs), [&](const Range& range) {
+        for (int j = range.start; j < range.end; j++) {
+            const string& trackername = trackers[j / n_cases];
+            const int c = j % n_cases;
 
-    vector<Rect2d> read;
-    int w, h, x, y;
-    for (vector<String>::iterator it = saved_box.begin();
-         it != saved_box.end(); it++) {
-         
-        sscanf((*it).c_str(), "[%d x %d from (%d, %d)]", &w, &h, &x, &y);
-        read.push_back(Rect2d(x,y,w,h));
+            Ptr<Tracker> tracker = createTrackerType(trackername);
+            if (tracker.empty()) {
+                cerr << "(evaluateCurves) Unknown tracker " << trackername << endl;
+                continue;
+            }
+            calculateCurves(cases[c].videoname, tracker, annots[c], jobs[j]);
+        }
+    }, n_jobs);
+
+    // merged in job order, so the result does not depend on the scheduling
+    vector<TrackingCurves> results(trackers.size());
+    for (int j = 0; j < n_jobs; j++) {
+        results[j / n_cases] += jobs[j];
     }
-    
-    return read;
+
+    return results;
+}
+
+static string queueItemId(const string& payload) {
+/*
+ * Id of a work item, the 64 bit FNV-1a hash of its payload, so an item keeps
+ * its id when the clip list or the tracker list is edited between two sweeps
+ */
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < payload.size(); i++) {
+        h = (h ^ (unsigned char) payload[i]) * 1099511628211ULL;
+    }
+    char id[32];
+    snprintf(id, sizeof(id), "%016llx", (unsigned long long) h);
+    return id;
+}
+
+static int queueSweep(const String dir, const vector<EvalCase>& cases,
+                      const vector<string>& trackers) {
+/*
+ * Coordinator: write one work item per (tracker, clip) pair into the queue
+ * directory, the items already queued, claimed or done are left as they are,
+ * the failed ones are queued again
+ */
+    if (!queue_init(dir)) {
+        cerr << "(queueSweep) Could not create the queue in " << dir << endl;
+        return 0;
+    }
+
+    int added = 0;
+    for (size_t t = 0; t < trackers.size(); t++) {
+        for (size_t c = 0; c < cases.size(); c++) {
+            string payload = trackers[t] + "\n" + cases[c].videoname + "\n" + cases[c].annotname + "\n";
+            if (queue_push(dir, queueItemId(payload), payload)) {
+                added++;
+            }
+        }
+    }
+    return added;
+}
+
+static void queueWorker(const String dir) {
+/*
+ * Worker: claim items until the queue is empty, each result is the tracker
+ * name followed by its curves on the clip.  The items whose tracker, video or
+ * annotation cannot be loaded are moved to failed instead of done
+ */
+    // the workers already fill the cores, one thread each
+    setNumThreads(1);
+
+    string id, payload;
+    while (queue_claim(dir, id, payload)) {
+        istringstream ss(payload);
+        string trackername;
+        EvalCase c;
+        getline(ss, trackername);
+        getline(ss, c.videoname);
+        getline(ss, c.annotname);
+
+        TrackingCurves curves;
+        Ptr<Tracker> tracker = createTrackerType(trackername);
+        if (tracker.empty()) {
+            cerr << "(queueWorker) Unknown tracker " << trackername << endl;
+            queue_fail(dir, id);
+            continue;
+        }
+        if (!calculateCurves(c.videoname, tracker, read_box(c.annotname), curves)) {
+            cerr << "(queueWorker) Item " << id << " failed, left in " << dir << "/failed" << endl;
+            queue_fail(dir, id);
+            continue;
+        }
+
+        ostringstream res;
+        res << trackername << "\n";
+        curves.write(res);
+        queue_complete(dir, id, res.str());
+    }
+}
+
+static void queueReduce(const String dir) {
+/*
+ * Reducer: merge the partial results of the queue per tracker, in id order
+ */
+    vector<pair<string, string> > results = queue_results(dir);
+    vector<string> trackers;
+    vector<TrackingCurves> merged;
+
+    for (size_t i = 0; i < results.size(); i++) {
+        istringstream ss(results[i].second);
+        string trackername;
+        TrackingCurves curves;
+        if (!getline(ss, trackername) || !curves.read(ss)) {
+            cerr << "(queueReduce) Bad result for item " << results[i].first << endl;
+            continue;
+        }
+
+        size_t t = find(trackers.begin(), trackers.end(), trackername) - trackers.begin();
+        if (t == trackers.size()) {
+            trackers.push_back(trackername);
+            merged.push_back(TrackingCurves());
+        }
+        merged[t] += curves;
+    }
+
+    cout << results.size() << " results, "
+         << queue_list(dir + "/todo").size() << " items left, "
+         << queue_list(dir + "/failed").size() << " failed" << endl;
+    for (size_t t = 0; t < trackers.size(); t++) {
+        merged[t].print(cout, trackers[t], true);
+    }
+}
+
+static void queueShard(const String dir, int n_workers) {
+/*
+ * Put back the items of crashed workers, run n_workers local worker
+ * processes until the queue is empty, then reduce
+ */
+    int requeued = queue_recover(dir, 24 * 3600);
+    if (requeued > 0) {
+        cout << requeued << " items of dead workers requeued" << endl;
+    }
+
+    vector<pid_t> workers;
+    for (int w = 0; w < n_workers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            queueWorker(dir);
+            _exit(0);
+        }
+        if (pid > 0) {
+            workers.push_back(pid);
+        }
+        else {
+            cerr << "(queueShard) Could not start worker " << w << endl;
+        }
+    }
+
+    for (size_t w = 0; w < workers.size(); w++) {
+        int status;
+        waitpid(workers[w], &status, 0);
+    }
+
+    queueReduce(dir);
+}
+
+struct SegmentResult {
+    vector<double> accs;        // IoU (or unbiased IoU) of each tracked frame, 0.0 on failure
+    TrackingCurves curves;
+    VotStats vot;
+};
+
+struct ReinitProtocol {
+/*
+ * VOT re-initialisation: after a failure (update returns false or IoU = 0)
+ * skip frames are passed over without being decoded, then the tracker is
+ * started again from the annotation. The burnin frames following every
+ * initialisation are left out of the accuracy.
+ */
+    bool enabled;
+    int skip;
+    int burnin;
+
+    ReinitProtocol() : enabled(false), skip(5), burnin(10) {}
+};
+
+static bool seekFrame(VideoCapture& video, const String videoname, size_t target) {
+/*
+ * Position the decoder so that the next read() returns frame target.  Seeking
+ * with CAP_PROP_POS_FRAMES is not frame-accurate with every codec: when the
+ * position reported afterwards is not target, the frames are grabbed forward
+ * from the reported position if it is earlier, from the start of a reopened
+ * video otherwise.  Returns false if the video ends before target.
+ */
+    if (target == 0) {
+        return true;
+    }
+    video.set(CAP_PROP_POS_FRAMES, (double) target);
+    double pos = video.get(CAP_PROP_POS_FRAMES);
+    if (pos == (double) target) {
+        return true;
+    }
+    if (!(pos >= 0 && pos < (double) target)) {
+        video.open(videoname);
+        pos = 0;
+    }
+    for (size_t i = (size_t) pos; i < target; i++) {
+        if (!video.grab()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void evaluateSegment(const String videoname, const string trackername,
+                            const vector<Rect2d>& bounds, size_t first, size_t last,
+                            bool unbiased, const ReinitProtocol& reinit, SegmentResult& res) {
+/*
+ * Track frames [first, last) with a fresh tracker initialised on the annotation
+ * of frame first, the decoder is positioned on first before reading (see seekFrame)
+ */
+    VideoCapture video;
+    video.open(videoname);
+
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video: " << videoname << endl;
+        return;
+    }
+
+    if (!seekFrame(video, videoname, first)) {
+        cerr << "(evaluateSegment) Could not seek to frame " << first << endl;
+        return;
+    }
+
+    const double area = video.get(CAP_PROP_FRAME_WIDTH) * video.get(CAP_PROP_FRAME_HEIGHT);
+    Ptr<Tracker> tracker;
+    Mat frame;
+    Rect2d trackingbox;
+    bool need_init = true;
+    size_t init_frame = first;
+    res.accs.reserve(last - first);
+
+    for (size_t i = first; i < last; ++i) {
+        bool readok = video.read(frame);
+        if (!readok) {
+            cerr << "(evaluateSegment) Problem occured in reading video frames\n";
+            break;
+        }
+
+        const Rect2d& annotbox = bounds.at(i);
+        if (need_init) {
+            // wait for an annotated frame, the trackers can not be init twice so create a new one
+            if (annotbox.area() <= 0) {
+                continue;
+            }
+            tracker = createTrackerType(trackername);
+            if (tracker.empty()) {
+                cerr << "(evaluateSegment) Unknown tracker " << trackername << endl;
+                return;
+            }
+            tracker->init(frame, annotbox);
+            trackingbox = annotbox;
+            init_frame = i;
+            need_init = false;
+            continue;
+        }
+
+        bool trackok = tracker->update(frame, trackingbox);
+        double iou = trackok ? IoU_eval(annotbox, trackingbox) : 0.0;
+        res.vot.add_tracked();
+
+        // the unannotated frames are tracked through but left out of the curves
+        const bool annotated = annotbox.area() > 0;
+        if (trackok) {
+            res.accs.push_back(unbiased ? unbiased_IoU_eval(annotbox, trackingbox, area) : iou);
+            if (annotated) {
+                res.curves.add(annotbox, trackingbox, iou);
+            }
+        }
+        else {
+            res.accs.push_back(0.0);
+            if (annotated) {
+                res.curves.add_failure();
+            }
+        }
+
+        bool failed = !trackok || (iou == 0.0 && annotated);
+        if (reinit.enabled && failed) {
+            res.vot.add_failure();
+            // the skipped frames are grabbed but never decoded nor tracked
+            for (int s = 0; s < reinit.skip && i + 1 < last; s++, i++) {
+                video.grab();
+            }
+            need_init = true;
+        }
+        else if (i - init_frame > (size_t) reinit.burnin) {
+            res.vot.add_accuracy(iou);
+        }
+    }
+}
+
+static vector<size_t> chunkStarts(const vector<Rect2d>& bounds, size_t n_frames, int n_chunks) {
+/*
+ * Split [0, n_frames) into n_chunks, each chunk start is moved forward to the
+ * next frame with a non empty annotation so that the tracker can be initialised
+ */
+    vector<size_t> starts;
+    for (int k = 0; k < n_chunks; k++) {
+        size_t s = n_frames * k / n_chunks;
+        while (s < n_frames && bounds[s].area() <= 0) {
+            s++;
+        }
+        if (s < n_frames && (starts.empty() || s > starts.back())) {
+            starts.push_back(s);
+        }
+    }
+    return starts;
+}
+
+vector<double> calculateIoU_chunked(const String videoname, const string trackername,
+                                    const vector<Rect2d>& bounds, int n_chunks,
+                                    bool unbiased, const ReinitProtocol& reinit,
+                                    TrackingCurves& curves, VotStats& vot) {
+/*
+ * VOT-style temporally parallel evaluation: the sequence is cut into n_chunks,
+ * every chunk is evaluated concurrently by its own decoder and tracker started
+ * from the ground truth, and the results are concatenated in frame order.
+ * The first frame of every chunk is an initialisation and is not evaluated.
+ */
+    VideoCapture video;
+    video.open(videoname);
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video: " << videoname << endl;
+        return vector<double>();
+    }
+    size_t n_frames = (size_t) video.get(VideoCaptureProperties::CAP_PROP_FRAME_COUNT);
+    n_frames = min(n_frames, bounds.size());
+    video.release();
+
+    vector<size_t> starts = chunkStarts(bounds, n_frames, max(n_chunks, 1));
+    const int n_segments = (int) starts.size();
+    vector<SegmentResult> segments(n_segments);
+
+    parallel_for_(Range(0, n_segments), [&](const Range& range) {
+        for (int k = range.start; k < range.end; k++) {
+            size_t last = (k + 1 < n_segments) ? starts[k + 1] : n_frames;
+            evaluateSegment(videoname, trackername, bounds, starts[k], last,
+                            unbiased, reinit, segments[k]);
+        }
+    }, n_segments);
+
+    vector<double> results;
+    results.reserve(n_frames);
+    for (int k = 0; k < n_segments; k++) {
+        results.insert(results.end(), segments[k].accs.begin(), segments[k].accs.end());
+        curves += segments[k].curves;
+        vot += segments[k].vot;
+    }
+
+    return results;
+}
+
+struct Perturbation {
+/*
+ * Photometric perturbation applied to the decoded frames:
+ *   none, gamma=G, bc=ALPHA:BETA, noise=SIGMA (gaussian), blur=KSIZE (gaussian)
+ */
+    string name;
+    char kind;
+    double a;
+    double b;
+    Mat lut;    // correction table of gamma and bc, computed once
+};
+
+static bool parsePerturbation(const string& spec, Perturbation& p) {
+    p.name = spec;
+    p.a = p.b = 0.0;
+    p.lut.release();
+    SpecItem item;
+    if (!parse_spec_item(spec, item)) {
+        return false;
+    }
+
+    if (item.key == "none" && !item.has_value) {
+        p.kind = 'o';
+        return true;
+    }
+    if (!item.has_value || (item.has_b && item.key != "bc")) {
+        return false;
+    }
+    p.a = item.a;
+    p.b = item.b;
+    if (item.key == "gamma") {
+        p.kind = 'g';
+        p.lut = gamma_lut(p.a);
+    }
+    else if (item.key == "bc") {
+        p.kind = 'c';
+        p.lut = bc_lut(p.a, p.b);
+    }
+    else if (item.key == "noise") {
+        if (p.a < 0) {
+            return false;
+        }
+        p.kind = 'n';
+    }
+    else if (item.key == "blur") {
+        int ksize;
+        if (!spec_ksize(item, ksize)) {
+            return false;
+        }
+        p.kind = 'b';
+        p.a = ksize;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static void applyPerturbation(const Perturbation& p, const Mat& src, Mat& dst, RNG& rng, Mat& noise) {
+    switch (p.kind) {
+        case 'g':
+        case 'c':
+            apply_lut(src, p.lut, dst);
+            break;
+        case 'n':
+            noise.create(src.size(), CV_MAKETYPE(CV_16S, src.channels()));
+            rng.fill(noise, RNG::NORMAL, 0, p.a);
+            add(src, noise, dst, noArray(), src.type());
+            break;
+        case 'b':
+            GaussianBlur(src, dst, Size((int) p.a, (int) p.a), 0);
+            break;
+        default:
+            src.copyTo(dst);
+    }
+}
+
+vector<TrackingCurves> evaluatePerturbed(const String videoname, const string trackername,
+                                         const vector<Rect2d>& bounds,
+                                         const vector<Perturbation>& perturbations) {
+/*
+ * Photometric robustness sweep: every frame is decoded once, then each
+ * perturbation variant is applied and tracked by its own tracker in parallel,
+ * without writing any corrected video
+ */
+    const int n_variants = (int) perturbations.size();
+    vector<TrackingCurves> curves(n_variants);
+
+    VideoCapture video;
+    video.open(videoname);
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video: " << videoname << endl;
+        return curves;
+    }
+
+    vector<Ptr<Tracker> > trackers(n_variants);
+    vector<Rect2d> trackingbox(n_variants);
+    vector<Mat> variant(n_variants), noise(n_variants);
+    vector<RNG> rng;
+    for (int v = 0; v < n_variants; v++) {
+        trackers[v] = createTrackerType(trackername);
+        if (trackers[v].empty()) {
+            cerr << "(evaluatePerturbed) Unknown tracker " << trackername << endl;
+            return curves;
+        }
+        rng.push_back(RNG(0x12345 + v));
+    }
+
+    size_t n_frames = (size_t) video.get(VideoCaptureProperties::CAP_PROP_FRAME_COUNT);
+    n_frames = min(n_frames, bounds.size());
+    Mat frame;
+
+    for (size_t i = 0; i < n_frames; ++i) {
+        bool readok = video.read(frame);
+        if (!readok) {
+            cerr << "(evaluatePerturbed) Problem occured in reading video frames\n";
+            break;
+        }
+
+        const Rect2d& annotbox = bounds.at(i);
+        parallel_for_(Range(0, n_variants), [&](const Range& range) {
+            for (int v = range.start; v < range.end; v++) {
+                applyPerturbation(perturbations[v], frame, variant[v], rng[v], noise[v]);
+                if (i == 0) {
+                    trackers[v]->init(variant[v], annotbox);
+                    trackingbox[v] = annotbox;
+                }
+                else if (!trackers[v]->update(variant[v], trackingbox[v])) {
+                    if (annotbox.area() > 0) {
+                        curves[v].add_failure();
+                    }
+                }
+                else if (annotbox.area() > 0) {
+                    curves[v].add(annotbox, trackingbox[v], IoU_eval(annotbox, trackingbox[v]));
+                }
+            }
+        }, n_variants);
+    }
+
+    return curves;
 }
 
 void drawrect(String vidname, String outfname, vector<Rect2d> bounds, const Scalar & colour) {
@@ -257,7 +742,6 @@ void calculateIoU_genvid(const string videoname, const string outfname,
                             string trackertype, vector<Rect2d> bounds, bool verbose) {
                             
     Ptr<Tracker> tracker = createTrackerType(trackertype);
-    double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg);
     
     // run the calculation according to the number of evaluation selected
     VideoCapture video;
@@ -374,7 +858,6 @@ void calculateIoU_genvid2(const string videoname, const string outfname,
                             string trackertype, vector<Rect2d> bounds, bool verbose) {
 
     Ptr<Tracker> tracker = createTrackerType(trackertype);
-    double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg);
     
     // run the calculation according to the number of evaluation selected
     VideoCapture video;
@@ -489,6 +972,115 @@ void calculateIoU_genvid2(const string videoname, const string outfname,
 
 
 int main(int argc, char ** argv) {
+    if (argc >= 4 && String(argv[1]) == "--curves") {
+        // success / precision curves of each tracker over a list of clips
+        vector<EvalCase> cases = read_cases(argv[2]);
+        vector<string> trackers(argv + 3, argv + argc);
+        vector<TrackingCurves> results = evaluateCurves(cases, trackers);
+
+        for (size_t t = 0; t < trackers.size(); t++) {
+            results[t].print(cout, trackers[t], true);
+        }
+        return 0;
+    }
+
+    if (argc == 6 && String(argv[1]) == "--chunks") {
+        // one clip cut into K chunks evaluated concurrently
+        int n_chunks = atoi(argv[2]);
+        vector<Rect2d> bounds = read_box(argv[4]);
+        TrackingCurves curves;
+        VotStats vot;
+        vector<double> res = calculateIoU_chunked(argv[3], argv[5], bounds, n_chunks,
+                                                  false, ReinitProtocol(), curves, vot);
+
+        cout << res.size() << " frames evaluated in " << n_chunks << " chunks" << endl;
+        curves.print(cout, argv[5], true);
+        return 0;
+    }
+
+    // sharded sweep through a queue directory, see include/work_queue.h
+    if (argc >= 5 && String(argv[1]) == "--queue") {
+        vector<EvalCase> cases = read_cases(argv[3]);
+        vector<string> trackers(argv + 4, argv + argc);
+        cout << queueSweep(argv[2], cases, trackers) << " items queued in " << argv[2] << endl;
+        return 0;
+    }
+    if (argc == 3 && String(argv[1]) == "--worker") {
+        queueWorker(argv[2]);
+        return 0;
+    }
+    if (argc == 4 && String(argv[1]) == "--shard") {
+        queueShard(argv[2], max(atoi(argv[3]), 1));
+        return 0;
+    }
+    if (argc == 3 && String(argv[1]) == "--reduce") {
+        queueReduce(argv[2]);
+        return 0;
+    }
+
+    if (argc >= 6 && String(argv[1]) == "--perturb") {
+        // robustness table over photometric perturbations, no intermediate video
+        vector<Perturbation> perturbations;
+        Perturbation p;
+        parsePerturbation("none", p);
+        perturbations.push_back(p);
+        for (int k = 5; k < argc; k++) {
+            if (!parsePerturbation(argv[k], p)) {
+                cerr << "Bad perturbation " << argv[k] << endl;
+                return 1;
+            }
+            perturbations.push_back(p);
+        }
+
+        vector<Rect2d> bounds = read_box(argv[3]);
+        vector<TrackingCurves> res = evaluatePerturbed(argv[2], argv[4], bounds, perturbations);
+
+        cout << "TRACKER: " << argv[4] << endl
+             << "perturbation      AUC     dAUC    prec@20  failures" << endl;
+        for (size_t v = 0; v < res.size(); v++) {
+            cout << setw(16) << left << perturbations[v].name << right << fixed << setprecision(4)
+                 << "  " << res[v].auc()
+                 << "  " << setw(7) << res[v].auc() - res[0].auc()
+                 << "  " << res[v].precision(20)
+                 << "  " << setw(8) << res[v].failures() << endl;
+        }
+        return 0;
+    }
+
+    if (argc >= 6 && String(argv[1]) == "--vot") {
+        // VOT re-initialisation protocol, every tracker on the clip in parallel
+        ReinitProtocol reinit;
+        reinit.enabled = true;
+        reinit.skip = atoi(argv[2]);
+        vector<Rect2d> bounds = read_box(argv[4]);
+        vector<string> trackers(argv + 5, argv + argc);
+        vector<SegmentResult> res(trackers.size());
+
+        parallel_for_(Range(0, (int) trackers.size()), [&](const Range& range) {
+            for (int t = range.start; t < range.end; t++) {
+                evaluateSegment(argv[3], trackers[t], bounds, 0, bounds.size(), false, reinit, res[t]);
+            }
+        }, (double) trackers.size());
+
+        for (size_t t = 0; t < trackers.size(); t++) {
+            res[t].vot.print(cout, trackers[t]);
+        }
+        return 0;
+    }
+
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " VIDEO ANNOTATION TRACKER" << endl
+             << "       " << argv[0] << " --curves CLIPLIST TRACKER [TRACKER ...]" << endl
+             << "       " << argv[0] << " --chunks K VIDEO ANNOTATION TRACKER" << endl
+             << "       " << argv[0] << " --vot SKIP VIDEO ANNOTATION TRACKER [TRACKER ...]" << endl
+             << "       " << argv[0] << " --perturb VIDEO ANNOTATION TRACKER SPEC [SPEC ...]" << endl
+             << "       " << argv[0] << " --queue DIR CLIPLIST TRACKER [TRACKER ...]" << endl
+             << "       " << argv[0] << " --shard DIR NWORKERS | --worker DIR | --reduce DIR" << endl
+             << "CLIPLIST holds one \"VIDEO ANNOTATION\" pair per line" << endl
+             << "SPEC: gamma=G | bc=ALPHA:BETA | noise=SIGMA | blur=KSIZE" << endl;
+        return 1;
+    }
+
     String vidname = argv[1];
     String textname = argv[2];
     String trackername = argv[3];
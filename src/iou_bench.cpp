@@ -0,0 +1,84 @@
+/* iou_bench.cpp
+ *
+ * Benchmark of the batch IoU kernels in include/iou.h against the scalar
+ * IoU_eval / unbiased_IoU_eval / centre_error, on random box pairs.
+ * The batch results are checked to be bit-identical to the scalar ones.
+ *
+ * usage: ./iou_bench [number_of_pairs]
+ */
+
+
+#include "opencv2/core.hpp"
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include "../include/iou.h"
+
+
+using namespace std;
+using namespace cv;
+
+
+static double elapsed_ms(int64 start) {
+    return 1000.0 * (getTickCount() - start) / getTickFrequency();
+}
+
+static bool same_bits(const vector<double>& a, const vector<double>& b) {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+}
+
+int main(int argc, char ** argv) {
+
+    const int n_pairs = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int n_runs = 10;
+    const double A_bg = 1920.0 * 1080.0;
+
+    // annotation boxes and tracker boxes jittered around them, some pairs do not overlap
+    RNG rng(42);
+    BoxSeq annot, track;
+    annot.reserve(n_pairs);
+    track.reserve(n_pairs);
+    for (int i = 0; i < n_pairs; i++) {
+        Rect2d a(rng.uniform(0, 1700), rng.uniform(0, 900), rng.uniform(10, 200), rng.uniform(10, 200));
+        Rect2d d(a.x + rng.uniform(-100, 100), a.y + rng.uniform(-100, 100),
+                 a.width * rng.uniform(0.5, 1.5), a.height * rng.uniform(0.5, 1.5));
+        annot.push_back(a);
+        track.push_back(d);
+    }
+
+    vector<double> scalar_res(n_pairs), batch_res(n_pairs);
+    const char* names[] = { "IoU", "unbiased IoU", "centre error" };
+
+    for (int k = 0; k < 3; k++) {
+
+        int64 start = getTickCount();
+        for (int r = 0; r < n_runs; r++) {
+            for (int i = 0; i < n_pairs; i++) {
+                Rect2d a = annot.at(i), d = track.at(i);
+                if (k == 0) scalar_res[i] = IoU_eval(a, d);
+                if (k == 1) scalar_res[i] = unbiased_IoU_eval(a, d, A_bg);
+                if (k == 2) scalar_res[i] = centre_error(a, d);
+            }
+        }
+        double scalar_ms = elapsed_ms(start) / n_runs;
+
+        start = getTickCount();
+        for (int r = 0; r < n_runs; r++) {
+            if (k == 0) IoU_batch(annot, track, batch_res.data());
+            if (k == 1) unbiased_IoU_batch(annot, track, A_bg, batch_res.data());
+            if (k == 2) centre_error_batch(annot, track, batch_res.data());
+        }
+        double batch_ms = elapsed_ms(start) / n_runs;
+
+        cout << names[k] << ": " << n_pairs << " pairs, scalar " << scalar_ms << "ms"
+             << ", batch " << batch_ms << "ms"
+             << ", speedup x" << scalar_ms / batch_ms
+             << (same_bits(scalar_res, batch_res) ? ", bit-identical" : ", MISMATCH") << endl;
+
+        if (!same_bits(scalar_res, batch_res)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
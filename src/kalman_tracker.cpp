@@ -45,6 +45,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <dirent.h>
 #include <unistd.h>
 #include "../include/kalman_filter.h"
+#include "../include/preproc.h"
+#include "../include/tracker_factory.h"
 
 #include <chrono>
 
@@ -52,57 +54,41 @@ using namespace std;
 using namespace cv;
 using namespace chrono;
 
-static Ptr<Tracker> createTrackerType(const string trackername) {
-    // create tracker according to the trackername specified
- 
-    Ptr<Tracker> tracker;
-    if (trackername == "MIL") {
-        tracker = TrackerMIL::create();
-    }
-    if (trackername == "Boosting") {
-        tracker = TrackerBoosting::create();
-    }
-    if (trackername == "KCF") {
-        tracker = TrackerKCF::create();
-    }
-    if (trackername == "TLD") {
-        tracker = TrackerTLD::create();
-    }
-    if (trackername == "MOSSE") {
-        tracker = TrackerMOSSE::create();
-    }
-    if (trackername == "CSRT") {
-        tracker = TrackerCSRT::create();
-    }
-    if (trackername == "MF") {
-        tracker = TrackerMedianFlow::create();
-    }
-    if (trackername == "HOG"){
-        //tracker = TrackerFeature::create("HOG");
-    }
-    if (trackername == "HAAR"){
-        //tracker = TrackerFeature::create("HAAR");
-    }
-    
-    return tracker;
-}
-
-void webcam_run(const string vidname, const string trackername) {
+void webcam_run(const string vidname, const string trackername, const string prespec, bool roi) {
     Ptr<Tracker> tracker = createTrackerType(trackername);
+
+    // frame enhancement inline, between capture and tracker
+    Preproc pre;
+    if (!pre.parse(prespec)) {
+        cerr << "Invalid preprocessing " << prespec << endl;
+        exit(1);
+    }
+    cout << "Preprocessing: " << pre.describe() << endl;
     
     cv::VideoCapture video;
     video.open(vidname);
     
     cv::namedWindow("Tracking");
     
+    // with --roi, chains keeping the frame size are only run in-place around
+    // the Kalman prediction, the trackers only search a neighbourhood of the target
+    if (roi && (pre.empty() || !pre.preserves_size())) {
+        cerr << "--roi ignored, it needs a preprocessing that keeps the frame size" << endl;
+    }
+    const bool roi_mode = roi && !pre.empty() && pre.preserves_size();
+    const double roi_margin = 1.0;
+
     cv::Mat frame;
+    cv::Mat processed;
+    // without preprocessing the tracker works on the decoded frame directly
+    cv::Mat& image = (pre.empty() || roi_mode) ? frame : processed;
     cv::Rect2d box;
     //bool is_first = true;
 
     string outfname = vidname;
     outfname.append("_output.avi");
     VideoWriter vout(outfname, VideoWriter::fourcc('M','J','P','G'), 20, 
-                Size( video.get(CAP_PROP_FRAME_WIDTH), video.get(CAP_PROP_FRAME_HEIGHT) ));
+                pre.output_size(Size( video.get(CAP_PROP_FRAME_WIDTH), video.get(CAP_PROP_FRAME_HEIGHT) )));
 
     Kalman kalman;
 	//microseconds T;
@@ -114,28 +100,42 @@ void webcam_run(const string vidname, const string trackername) {
     
     //const unsigned int n_frames = video.get(VideoCaptureProperties::CAP_PROP_FRAME_COUNT);
     video.read(frame);
-    Rect2d initbox = cv::selectROI("Tracking", frame);
-    tracker->init(frame, initbox);
+    pre.process(frame, processed);
+    Rect2d initbox = cv::selectROI("Tracking", pre.empty() ? frame : processed);
+    if (roi_mode) {
+        // the tracker is initialised on the same pixels it sees later on, the
+        // frame enhanced around the target only
+        pre.process_window(frame, expand_roi(initbox, roi_margin, frame.size()));
+    }
+    tracker->init(image, initbox);
+    Rect2d predicted = initbox;
     if(waitKey(0) == 27) destroyWindow("Tracking");
     
     printf("Initiated\n");
-    vout << frame;
+    vout << image;
     while (video.read(frame)) {
         auto T = duration_cast<microseconds>(system_clock::now().time_since_epoch());
-        tracker->update(frame, box);
-        cv::rectangle(frame, box, cv::Scalar(0, 0, 255), 3);
+        if (roi_mode) {
+            pre.process_window(frame, expand_roi(predicted, roi_margin, frame.size()));
+        }
+        else {
+            pre.process(frame, image);
+        }
+        tracker->update(image, box);
+        cv::rectangle(image, box, cv::Scalar(0, 0, 255), 3);
         
         auto T_new = duration_cast<microseconds>(system_clock::now().time_since_epoch());
         auto kalman_box = kalman.predict(float((T_new - T).count()) / 1'000'000, box);
+        predicted = kalman_box;
         //cout << kalman_box;
-        cv::rectangle(frame, kalman_box, cv::Scalar(0, 255, 0), 3);
+        cv::rectangle(image, kalman_box, cv::Scalar(0, 255, 0), 3);
         
         printf("after update {%d, %d, %d, %d}  ---  {%d, %d, %d, %d}\n",
                 box.x, box.y, box.width, box.height,
                 kalman_box.x, kalman_box.y, kalman_box.width, kalman_box.height
                 );
                 //cv::imshow("Tracking",frame);
-        vout << frame;
+        vout << image;
     }
 
     //video.release();
@@ -146,7 +146,23 @@ void webcam_run(const string vidname, const string trackername) {
 int main(int argc, char* argv[]){
 //int main(void){
     
-	webcam_run(argv[1], argv[2]);
+	// optional third argument: preprocessing spec, e.g. "gamma=0.7,downscale=2",
+	// --roi (anywhere) runs it only around the target
+	bool roi = false;
+	vector<string> args;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--roi") {
+			roi = true;
+		}
+		else {
+			args.push_back(argv[i]);
+		}
+	}
+	if (args.size() < 2) {
+		cerr << "Usage: " << argv[0] << " VIDEO TRACKER [PREPROC] [--roi]" << endl;
+		return 1;
+	}
+	webcam_run(args[0], args[1], args.size() > 2 ? args[2] : "", roi);
 
 }
 
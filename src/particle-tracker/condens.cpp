@@ -1,80 +1,280 @@
 #include "condens.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
 using namespace cv;
 using namespace std;
 
 typedef unsigned int uint;
 
-ConDensation::ConDensation(unsigned int num_states, unsigned int num_particles)
+// Sum of a[i] * b[i]
+static float dot_row(const float* a, const float* b, int n)
+{
+   int i = 0;
+   float sum = 0.f;
+#if CV_SIMD
+   v_float32 acc = vx_setzero_f32();
+   for( ; i <= n - v_float32::nlanes; i += v_float32::nlanes )
+   {
+      acc = v_fma(vx_load(a + i), vx_load(b + i), acc);
+   }
+   sum = v_reduce_sum(acc);
+   vx_cleanup();
+#endif
+   for( ; i < n; i++ )
+   {
+      sum += a[i] * b[i];
+   }
+   return sum;
+}
+
+// y[i] += t * x[i], n is a multiple of the vector width (padded rows)
+static void axpy_row(float* y, float t, const float* x, int n)
+{
+   int i = 0;
+#if CV_SIMD
+   v_float32 vt = vx_setall_f32(t);
+   for( ; i <= n - v_float32::nlanes; i += v_float32::nlanes )
+   {
+      v_store(y + i, v_fma(vt, vx_load(x + i), vx_load(y + i)));
+   }
+   vx_cleanup();
+#endif
+   for( ; i < n; i++ )
+   {
+      y[i] += t * x[i];
+   }
+}
+
+ConDensation::ConDensation(unsigned int num_states, unsigned int num_particles, unsigned int max_particles)
    :m_num_states(num_states),
     m_transition_matrix(m_num_states, m_num_states),
     m_state(m_num_states, 1),
     m_num_particles(num_particles),
-    m_particles(),
-    m_confidence(),
-    m_new_particles(), 
-    m_cumulative(),
+    m_max_particles(MAX(num_particles, max_particles)),
+    m_stride((m_max_particles + PARTICLE_ALIGN - 1) / PARTICLE_ALIGN * PARTICLE_ALIGN),
+    m_particles(Mat_<float>::zeros(m_num_states, m_stride)),
+    m_confidence(m_max_particles, 1.0 / num_particles),
+    m_new_particles(Mat_<float>::zeros(m_num_states, m_stride)), 
+    m_cumulative(m_max_particles, 1.0),
+    m_resampled(m_max_particles, 0),
+    m_prior(m_max_particles, 1.f),
     m_temp(m_num_states, 1),
     m_rng(),
-    m_std_dev(0)
+    m_std_dev(0),
+    m_method(RESAMPLE_SYSTEMATIC),
+    m_ess_fraction(0),
+    m_ess(num_particles),
+    m_did_resample(true),
+    m_min_particles(m_max_particles),
+    m_bin_size(),
+    m_kld_epsilon(0.05f),
+    m_kld_z(2.326f),
+    m_next_particles(num_particles),
+    m_occupied_bins(0),
+    m_bin_keys()
 {
-   const float prob  = 1.0 / num_particles;
-    for(uint i = 0; i < num_particles; i++)
-    {
-       m_particles.push_back(Mat_<float>(m_num_states, 1));
-       m_new_particles.push_back(Mat_<float>(m_num_states, 1));
-       m_confidence.push_back(prob);
-       m_cumulative.push_back(1.0);
-    }    
 }
 
 ConDensation::~ConDensation()
 {}
 
+void ConDensation::set_resampling(ResampleMethod method, float ess_fraction)
+{
+   m_method = method;
+   m_ess_fraction = ess_fraction;
+}
+
+void ConDensation::set_adaptive(uint min_particles, const float bin_size[], float epsilon, float z)
+{
+   m_min_particles = MIN(MAX(min_particles, 1u), m_max_particles);
+   m_bin_size.assign(bin_size, bin_size + m_num_states);
+   m_kld_epsilon = epsilon;
+   m_kld_z = z;
+   m_bin_keys.reserve(m_max_particles);
+}
+
+void ConDensation::reset_weights()
+{
+   fill(m_confidence.begin(), m_confidence.end(), 1.f / m_num_particles);
+   fill(m_prior.begin(), m_prior.end(), 1.f);
+}
+
+// Indices drawn at u, u + step, u + 2 step, ... (systematic) or one draw per
+// stratum of width step (stratified), in a single forward walk of the
+// cumulative weights.
+void ConDensation::resample_walk(uint first, uint count, double total, bool stratified)
+{
+   const double step = total / count;
+   const double offset = m_rng.uniform(0., step);
+   uint j = 0;
+   for( uint k = 0; k < count; k++ )
+   {
+      double u = stratified ? (k + m_rng.uniform(0., 1.)) * step : offset + k * step;
+      while( (m_cumulative[j] <= u) && (j < m_num_particles-1) )
+      {
+	 j++;
+      }
+      m_resampled[first + k] = j;
+   }
+}
+
+// floor(count w) copies of each particle, the remaining draws are systematic
+// on the residual weights.
+void ConDensation::resample_residual(double sum, uint count)
+{
+   const double scale = count / sum;
+   uint k = 0;
+   double residual = 0;
+   for( uint j = 0; j < m_num_particles; j++ )
+   {
+      double expected = m_confidence[j] * scale;
+      uint copies = (uint) expected;
+      for( uint c = 0; c < copies && k < count; c++ )
+      {
+	 m_resampled[k++] = j;
+      }
+      residual += expected - copies;
+      m_cumulative[j] = residual;
+   }
+   if( k < count )
+   {
+      resample_walk(k, count - k, residual, false);
+   }
+}
+
+/**
+ * Particle count bounding the KL divergence for the bins occupied by the
+ * m_num_particles particles of m_new_particles (Fox, KLD-sampling):
+ *
+ *   n = (k - 1) / (2 epsilon) * (1 - 2 / (9 (k - 1)) + sqrt(2 / (9 (k - 1))) z)^3
+ *
+ * The bins are counted by sorting a hash of their coordinates.
+ */
+uint ConDensation::kld_count()
+{
+   m_bin_keys.resize(m_num_particles);
+   for( uint i = 0; i < m_num_particles; i++ )
+   {
+      uint64_t key = 0;
+      for( uint j = 0; j < m_num_states; j++ )
+      {
+	 if( m_bin_size[j] > 0 )
+	 {
+	    int64_t bin = cvFloor(m_new_particles(j, i) / m_bin_size[j]);
+	    key = (key ^ (uint64_t) bin) * 0x100000001b3ULL;
+	 }
+      }
+      m_bin_keys[i] = key;
+   }
+   sort(m_bin_keys.begin(), m_bin_keys.end());
+   m_occupied_bins = unique(m_bin_keys.begin(), m_bin_keys.end()) - m_bin_keys.begin();
+
+   double n = m_min_particles;
+   if( m_occupied_bins > 1 )
+   {
+      double k = m_occupied_bins - 1;
+      double a = 2. / (9. * k);
+      double b = 1. - a + sqrt(a) * m_kld_z;
+      n = k / (2. * m_kld_epsilon) * b * b * b;
+   }
+   return (uint) MIN(MAX(n, (double) m_min_particles), (double) m_max_particles);
+}
+
 void ConDensation::time_update()
 {
-    float sum = 0;
+    double sum = 0;
+    double sum_sq = 0;
 
-    // Calculate the weighted mean of the particles
-    m_temp = Mat_<float>::zeros(m_temp.size());
+    // Weights carried over when the previous step did not resample
     for( uint i = 0; i < m_num_particles; i++ )
     {
-       m_state = m_particles[i] * m_confidence[i];
-       m_temp += m_state;
-
-       sum += m_confidence[i];
+       float w = m_confidence[i] * m_prior[i];
+       m_confidence[i] = w;
+       sum += w;
+       sum_sq += (double) w * w;
        m_cumulative[i] = sum;
     }
+    m_ess = sum_sq > 0 ? sum * sum / sum_sq : 0;
+
+    // Calculate the weighted mean of the particles, a dot product per state
+    for( uint j = 0; j < m_num_states; j++ )
+    {
+       m_temp(j) = dot_row(m_particles[j], &m_confidence[0], m_num_particles);
+    }
 
     // Transform the mean state by the dynamics matrix
     m_temp *= 1.f / sum;
     m_state = m_transition_matrix * m_temp;
-    
-    float mean_confidence = sum / m_num_particles;
 
-    // Systematic resampling.  A particle is selected
-    // repeatedly until it's confidence is less than 
-    // the expected cumulative confidence for that index.
-    for(uint i = 0; i < m_num_particles; i++ )
+    // Resampling is skipped while the weights are healthy, they are then
+    // carried to the next step instead
+    m_did_resample = m_ess < m_ess_fraction * m_num_particles || m_ess_fraction <= 0;
+    if( m_did_resample )
+    {
+       // The adaptive count changes here only, with the selected particles
+       const uint count = adaptive() ? m_next_particles : m_num_particles;
+       switch( m_method )
+       {
+	  case RESAMPLE_STRATIFIED:
+	     resample_walk(0, count, sum, true);
+	     break;
+	  case RESAMPLE_RESIDUAL:
+	     resample_residual(sum, count);
+	     break;
+	  default:
+	     resample_walk(0, count, sum, false);
+       }
+
+       // Gather the selected particles, one state row at a time
+       for( uint j = 0; j < m_num_states; j++ )
+       {
+	  const float* src = m_particles[j];
+	  float* dst = m_new_particles[j];
+	  for( uint i = 0; i < count; i++ )
+	  {
+	     dst[i] = src[m_resampled[i]];
+	  }
+	  // Particle 0 carries the mean state
+	  dst[0] = m_state(j);
+       }
+       m_num_particles = count;
+       fill(m_prior.begin(), m_prior.begin() + count, 1.f);
+
+       if( adaptive() )
+       {
+	  m_next_particles = kld_count();
+       }
+    }
+    else
     {
-        uint j = 0;
-        while( (m_cumulative[j] <= (float) i * mean_confidence) && ( j < m_num_particles-1))
-        {
-            j++;
-        }
-	m_particles[j].copyTo(m_new_particles[i]);
+       // The particles stay, they only swap buffers
+       cv::swap(m_particles, m_new_particles);
+       for( uint i = 0; i < m_num_particles; i++ )
+       {
+	  m_prior[i] = m_confidence[i] * m_num_particles / sum;
+       }
     }
-    // Since particle 0 always gets chosen by the above, assign the mean state to it
-    m_state.copyTo(m_new_particles[0]);
 
-    // Transform and randomly perturb the new particles
-    for( uint i = 0; i < m_num_particles; i++ )
+    // Transform and randomly perturb the new particles.  The result goes back
+    // into m_particles, whose content is no longer needed: the two sets swap
+    // roles without any copy.  Only the rows up to the padded count are
+    // processed, the rest of the storage is left as is.
+    const uint padded = (m_num_particles + PARTICLE_ALIGN - 1) / PARTICLE_ALIGN * PARTICLE_ALIGN;
+    for( uint r = 0; r < m_num_states; r++ )
     {
-        for( uint j = 0; j < m_num_states; j++ )
-        {
-	   m_temp(j) = m_rng.gaussian(m_std_dev[j]);
-	}
-	m_particles[i] = m_transition_matrix * m_new_particles[i];
-	m_particles[i] += m_temp;
+       float* dst = m_particles[r];
+       Mat noise(1, m_num_particles, CV_32F, dst);
+       m_rng.fill(noise, RNG::NORMAL, 0, m_std_dev[r]);
+       fill(dst + m_num_particles, dst + padded, 0.f);
+
+       for( uint c = 0; c < m_num_states; c++ )
+       {
+	  float t = m_transition_matrix(r, c);
+	  if( t != 0.f )
+	  {
+	     axpy_row(dst, t, m_new_particles[c], padded);
+	  }
+       }
     }
 }
 
@@ -82,16 +282,21 @@ void ConDensation::init_sample_set(const float initial[], const float std_dev[]
 {
    m_std_dev = std_dev;
 
+   // The adaptive count starts at the maximum, the state is not known yet
+   if( adaptive() )
+   {
+      m_num_particles = m_next_particles = m_max_particles;
+   }
+
    for( uint i = 0; i < m_num_particles; i++ )
    {
       for( uint j = 0; j < m_num_states; j++ )
       {
 	 float r = m_rng.gaussian(m_std_dev[j]);
-	 m_particles[i](j) = initial[j] + r;
+	 particle(i, j) = initial[j] + r;
       }
-
-      m_confidence[i] = 1.0 / (float)m_num_particles;
    }
+   reset_weights();
 
    for( uint j = 0; j < m_num_states; j++)
    {
@@ -20,34 +20,126 @@
  */
 
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
 
+/**
+ * Particles are stored as a structure of arrays: row j of m_particles holds
+ * state dimension j of every particle, so the propagation is a few passes over
+ * contiguous floats instead of one small matrix product per particle.  Rows
+ * are padded to a multiple of PARTICLE_ALIGN floats (64 bytes), so every row
+ * keeps the alignment of the allocation and the SIMD loops need no tail.
+ */
 class ConDensation
 {
 public:
 
+   enum { PARTICLE_ALIGN = 16 };
+
+   /**
+    * All O(N), with a single forward walk of the cumulative weights:
+    * systematic (one random offset), stratified (one draw per stratum),
+    * residual (deterministic copies, then systematic on the residuals).
+    */
+   enum ResampleMethod
+   {
+      RESAMPLE_SYSTEMATIC,
+      RESAMPLE_STRATIFIED,
+      RESAMPLE_RESIDUAL
+   };
+
+   // The storage is sized for max_particles (at least num_particles) once,
+   // the adaptive particle count then never reallocates
    ConDensation( unsigned int dynam_params,
-		 unsigned int num_particles );
+		 unsigned int num_particles,
+		 unsigned int max_particles = 0 );
 
    virtual ~ConDensation();
 
    void init_sample_set(const float initial[], const float std_dev[] );
 
    void time_update();
+
+   // Resample only when the effective sample size falls below
+   // ess_fraction * N, always when ess_fraction <= 0 (default)
+   void set_resampling(ResampleMethod method, float ess_fraction);
+
+   /**
+    * KLD-sampling: after each resampling, the number of particles of the next
+    * one is chosen from the number k of bins of the state space occupied by
+    * the resampled particles, as the size bounding the Kullback-Leibler
+    * divergence of the sample to the posterior by epsilon with probability
+    * given by the normal quantile z, within [min_particles, max_particles].
+    * bin_size gives the bin width of each state, 0 to ignore a state.  The
+    * count only changes when resampling, and starts at the maximum.
+    */
+   void set_adaptive(unsigned int min_particles, const float bin_size[],
+		     float epsilon = 0.05f, float z = 2.326f);
+
+   bool adaptive() const
+   { return m_min_particles < m_max_particles; }
+
+   unsigned int num_particles() const
+   { return m_num_particles; }
+
+   unsigned int max_particles() const
+   { return m_max_particles; }
+
+   // Bins occupied by the last resampled set, 0 when not adaptive
+   unsigned int occupied_bins() const
+   { return m_occupied_bins; }
+
+   float effective_sample_size() const
+   { return m_ess; }
+
+   bool resampled() const
+   { return m_did_resample; }
+
+   // State dimension j of particle i
+   float& particle(unsigned int i, unsigned int j)
+   { return m_particles(j, i); }
+
+   float particle(unsigned int i, unsigned int j) const
+   { return m_particles(j, i); }
    
 
 protected:
 
+   // Uniform weights, e.g. after the particles have been redistributed
+   void reset_weights();
+
    unsigned int m_num_states;
    cv::Mat_<float> m_transition_matrix;   // Matrix of the linear system  
    cv::Mat_<float>  m_state;              // Vector of current State
    unsigned int m_num_particles;          //  Number of the Samples 
-   std::vector<cv::Mat_<float> > m_particles;      // Current particle vectors
+   unsigned int m_max_particles;          // Capacity of the storage
+   unsigned int m_stride;                 // Padded capacity, row length
+   cv::Mat_<float> m_particles;           // Current particles, one row per state
    std::vector<float> m_confidence;      // Confidence for each particle vector 
-   std::vector<cv::Mat_<float> > m_new_particles;  // New samples
-   std::vector<float> m_cumulative;      // Cumulative confidence vector    
+   cv::Mat_<float> m_new_particles;       // Resampled particles, same layout
+   std::vector<double> m_cumulative;     // Cumulative confidence vector, double for 100k particles
+   std::vector<unsigned int> m_resampled; // Particle drawn for each new sample
+   std::vector<float> m_prior;           // Weights carried over when not resampled
    cv::Mat_<float> m_temp;               // Temporary vector 
    cv::RNG m_rng;                        // Random generator
    const float* m_std_dev;
+   ResampleMethod m_method;
+   float m_ess_fraction;
+   float m_ess;                          // Effective sample size of the last step
+   bool m_did_resample;
+   unsigned int m_min_particles;          // Adaptive count when below m_max_particles
+   std::vector<float> m_bin_size;
+   float m_kld_epsilon;
+   float m_kld_z;
+   unsigned int m_next_particles;         // Count of the next resampling
+   unsigned int m_occupied_bins;
+   std::vector<uint64_t> m_bin_keys;    // Bin of each resampled particle, scratch
+
+private:
+
+   void resample_walk(unsigned int first, unsigned int count, double total, bool stratified);
+   void resample_residual(double sum, unsigned int count);
+   unsigned int kld_count();
    
 };
                                
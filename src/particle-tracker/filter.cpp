@@ -30,10 +30,26 @@ using namespace cv;
 using namespace std;
 typedef unsigned int uint;
 
-ParticleFilter::ParticleFilter(int num_particles)
-   :ConDensation(NUM_STATES, num_particles),
-    m_mean_confidence(0.f)
-{}
+ParticleFilter::ParticleFilter(int num_particles, int max_particles)
+   :ConDensation(NUM_STATES, num_particles, max_particles),
+    m_mean_confidence(0.f),
+    m_hist_mode(HIST_AUTO),
+    m_integral_limit(1 << 24),
+    m_used_integral(false),
+    m_sparse_lbp(true),
+    m_target_sum(0),
+    m_redistributed(true),
+    m_update_ms(0)
+{
+   m_regions.reserve(m_max_particles);
+}
+
+void ParticleFilter::set_adaptive(uint min_particles, float epsilon)
+{
+   // Bins of 4 pixels, 1 pixel per frame and 5% of scale
+   static const float bin_size[NUM_STATES] = {4, 4, 1, 1, .05};
+   ConDensation::set_adaptive(min_particles, bin_size, epsilon);
+}
 
 ParticleFilter::~ParticleFilter()
 {}
@@ -68,24 +84,53 @@ void ParticleFilter::init(const Rect& selection)
  */
 Mat& ParticleFilter::update(Mat& image, Mat& lbp_image, const Size& target_size, Mat& target_hist, bool use_lbp)
 {
-   Mat hist;
    Rect bounds(0,0,image.cols, image.rows);
 
-   // Update the confidence for each particle
-   for( uint i = 0; i< m_num_particles; i++)
+   int64 start = getTickCount();
+   m_redistributed = false;
+
+   // Region of each particle
+   m_regions.resize(m_num_particles);
+   Rect cloud;
+   for( uint i = 0; i < m_num_particles; i++ )
    {
-      float scale = MAX(0.1, m_particles[i](STATE_SCALE));
-      m_particles[i](STATE_SCALE) = scale;
-      int width = round(target_size.width * scale);
-      int height = round(target_size.height * scale);
-      int x = round(m_particles[i](STATE_X)) - width / 2;
-      int y = round(m_particles[i](STATE_Y)) - height / 2;
+      float scale = MAX(0.1, particle(i, STATE_SCALE));
+      particle(i, STATE_SCALE) = scale;
+      m_regions[i] = region_of(particle(i, STATE_X), particle(i, STATE_Y), scale, target_size) & bounds;
+      cloud |= m_regions[i];
+   }
 
-      Rect region = Rect(x, y, width, height) & bounds;
-      Mat image_roi(image, region), lbp_roi(lbp_image, region);
+   // Quantize the part of the frame the particles read once, the particle
+   // histograms then count over the map
+   calc_bin_map(image, lbp_image, m_bins, use_lbp, cloud);
 
-      m_confidence[i] = calc_likelyhood(image_roi, lbp_roi, target_hist, use_lbp);
+   m_used_integral = choose_integral(bounds, hist_num_bins(use_lbp));
+
+   // Update the confidence for each particle.  The particles are split in a
+   // fixed set of stripes evaluated in parallel, each with its own histogram
+   // scratch, and each confidence only depends on its particle.
+   const int num_stripes = MIN((int)m_num_particles, 4 * getNumThreads());
+   if( (int)m_scratch.size() < num_stripes )
+   {
+      m_scratch.resize(num_stripes);
+      m_sparse.resize(num_stripes);
    }
+   CV_Assert(target_hist.type() == CV_32F && (int)target_hist.total() == hist_num_bins(use_lbp));
+   cv::sqrt(target_hist, m_sqrt_target);
+   m_target_sum = sum(target_hist)[0];
+
+   parallel_for_(Range(0, num_stripes), [&](const Range& stripes)
+   {
+      for( int s = stripes.start; s < stripes.end; s++ )
+      {
+	 uint first = (uint)((uint64)m_num_particles * s / num_stripes);
+	 uint last = (uint)((uint64)m_num_particles * (s + 1) / num_stripes);
+	 for( uint i = first; i < last; i++ )
+	 {
+	    m_confidence[i] = calc_likelyhood(m_regions[i], use_lbp, s);
+	 }
+      }
+   });
 
    // Project the state forward in time
    time_update();
@@ -93,15 +138,11 @@ Mat& ParticleFilter::update(Mat& image, Mat& lbp_image, const Size& target_size,
    // Update the confidence at the mean state
    float scale = MAX(0.1, m_state(STATE_SCALE));
    m_state(STATE_SCALE) = scale;
-   int width = round(target_size.width * scale);
-   int height = round(target_size.height * scale);
-   int x = round(m_state(STATE_X)) - width / 2;
-   int y = round(m_state(STATE_Y)) - height / 2;
-
-   Rect region = Rect(x, y, width, height) & bounds;
-   Mat image_roi(image, region), lbp_roi(lbp_image, region);
+   Rect region = region_of(m_state(STATE_X), m_state(STATE_Y), scale, target_size) & bounds;
+   if( (region & cloud) != region )
+      calc_bin_map(image, lbp_image, m_bins, use_lbp, region);
 
-   m_mean_confidence = calc_likelyhood(image_roi, lbp_roi, target_hist, use_lbp);
+   m_mean_confidence = calc_likelyhood(region, use_lbp, 0);
 
    // Redistribute particles to reacquire the target if the mean state moves 
    // off screen.  This usually means the target has been lost due to a mismatch
@@ -114,24 +155,82 @@ Mat& ParticleFilter::update(Mat& image, Mat& lbp_image, const Size& target_size,
       cout << "Redistribute: " << m_state << " " << m_mean_confidence << endl;
       redistribute( lower_bound, upper_bound );
    }
- 
+
+   m_update_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
    return m_state;
 }
 
 
-// Calculate the likelyhood for a particular region
-float ParticleFilter::calc_likelyhood(Mat& image_roi, Mat& lbp_roi, Mat& target_hist, bool use_lbp )
+/**
+ * Build the integral histogram over the bounding box of the particle regions
+ * if it is cheaper than counting every region.  Counting costs the total area
+ * of the regions, the integral histogram its build (a copy and an add per bin
+ * and pixel of the box, about a quarter of a scattered count each) plus four
+ * reads per bin and particle.
+ */
+bool ParticleFilter::choose_integral(const Rect& bounds, int num_bins)
+{
+   static const double STEP_COST = 0.25;
+
+   if( m_hist_mode == HIST_DIRECT || m_regions.empty() )
+      return false;
+
+   Rect cloud = m_regions[0];
+   double direct_cost = 0;
+   for( size_t i = 0; i < m_regions.size(); i++ )
+   {
+      cloud |= m_regions[i];
+      direct_cost += m_regions[i].area();
+   }
+   cloud &= bounds;
+
+   double entries = IntegralHistogram::entries(cloud.size(), num_bins);
+   double integral_cost = STEP_COST * (entries + 4.0 * num_bins * m_regions.size());
+   if( cloud.empty() || entries > m_integral_limit ||
+       (m_hist_mode == HIST_AUTO && integral_cost >= direct_cost) )
+      return false;
+
+   m_integral.build(m_bins, cloud, num_bins);
+   return true;
+}
+
+/**
+ * Calculate the likelyhood for a particular region, with the histogram scratch
+ * of the caller's stripe.  The histogram is compared unnormalized with the
+ * square roots of the target bins: with c the Bhattacharyya coefficient, the
+ * distance of compareHist is sqrt(1 - c), so exp(-LAMBDA * d^2) needs no
+ * square root.  No overlap at all (c = 0) is clamped to 0 likelyhood.
+ */
+float ParticleFilter::calc_likelyhood(const Rect& region, bool use_lbp, int scratch )
 {
    static const float LAMBDA = 20.f;
-   static Mat hist;
+   const int num_bins = hist_num_bins(use_lbp);
+   const float* sqrt_target = m_sqrt_target.ptr<float>();
 
-   calc_hist(image_roi, lbp_roi, hist, use_lbp);
-   normalize(hist, hist);
+   double coeff;
+   if( m_used_integral && m_integral.contains(region) )
+   {
+      Mat& hist = m_scratch[scratch];
+      create_hist(hist, use_lbp);
+      m_integral.lookup(region, hist.ptr<float>());
+      coeff = bhattacharyya_coeff(hist.ptr<float>(), sqrt_target, num_bins, m_target_sum);
+   }
+   else if( use_lbp && m_sparse_lbp )
+   {
+      SparseHist& hist = m_sparse[scratch];
+      calc_sparse_hist_bins(Mat(m_bins, region), hist, num_bins);
+      coeff = sparse_bhattacharyya_coeff(hist, sqrt_target, m_target_sum);
+   }
+   else
+   {
+      Mat& hist = m_scratch[scratch];
+      calc_hist_bins(Mat(m_bins, region), hist, use_lbp);
+      coeff = bhattacharyya_coeff(hist.ptr<float>(), sqrt_target, num_bins, m_target_sum);
+   }
 
-   float bc = compareHist(target_hist, hist, HISTCMP_BHATTACHARYYA);
    float prob = 0.f;
-   if(bc != 1.f) // Clamp total mismatch to 0 likelyhood
-      prob = exp(-LAMBDA * (bc * bc) );
+   if( coeff > 0 )
+      prob = exp(-LAMBDA * MAX(1. - coeff, 0.));
    return prob;
 }
 
@@ -159,10 +258,10 @@ void ParticleFilter::draw_particles(Mat& image, const Size& target_size, const S
    Rect rect;
    for(uint i = 0; i < m_num_particles; i++)
    {
-      int width = round(target_size.width * m_particles[i](STATE_SCALE));
-      int height = round(target_size.height * m_particles[i](STATE_SCALE));
-      int x = round(m_particles[i](STATE_X)) - width/2;
-      int y = round(m_particles[i](STATE_Y)) - height/2;
+      int width = round(target_size.width * particle(i, STATE_SCALE));
+      int height = round(target_size.height * particle(i, STATE_SCALE));
+      int x = round(particle(i, STATE_X)) - width/2;
+      int y = round(particle(i, STATE_Y)) - height/2;
       rect = Rect(x, y, width, height) & bounds;
       rectangle(image, rect, color, 1);
    }
@@ -172,15 +271,49 @@ void ParticleFilter::draw_particles(Mat& image, const Size& target_size, const S
 
 void ParticleFilter::redistribute(const float lbound[], const float ubound[] )
 {
+   // The whole frame is searched again, with all the particles
+   if( adaptive() )
+      m_num_particles = m_next_particles = m_max_particles;
+
    for( uint i = 0; i < m_num_particles; i++ )
    {
       for( uint j = 0; j < m_num_states; j++ )
       {
 	 float r = m_rng.uniform(lbound[j], ubound[j]);
-	 m_particles[i](j) = r;
+	 particle(i, j) = r;
       }
-
-      m_confidence[i] = 1.0 / (float)m_num_particles;
    }
+   reset_weights();
+   m_redistributed = true;
+}
 
+// Region of the target centred on (x, y) at scale, not clipped
+Rect ParticleFilter::region_of(float x, float y, float scale, const Size& target_size)
+{
+   int width = round(target_size.width * scale);
+   int height = round(target_size.height * scale);
+   return Rect(round(x) - width / 2, round(y) - height / 2, width, height);
+}
+
+/**
+ * Window of the frame read by the next update: the bounding box of the
+ * regions of the particles, which are already propagated, grown by margin
+ * times the target size on each side for the mean state and clipped to the
+ * frame.  After a redistribution the particles cover the frame, which is
+ * then returned whole.
+ */
+Rect ParticleFilter::search_window(const Size& target_size, const Size& frame_size, double margin) const
+{
+   Rect frame(Point(0, 0), frame_size);
+   if( m_redistributed || m_num_particles == 0 )
+      return frame;
+
+   Rect cloud;
+   for( uint i = 0; i < m_num_particles; i++ )
+   {
+      float scale = MAX(0.1, particle(i, STATE_SCALE));
+      cloud |= region_of(particle(i, STATE_X), particle(i, STATE_Y), scale, target_size);
+   }
+   int dx = cvCeil(margin * target_size.width), dy = cvCeil(margin * target_size.height);
+   return Rect(cloud.x - dx, cloud.y - dy, cloud.width + 2 * dx, cloud.height + 2 * dy) & frame;
 }
@@ -21,6 +21,8 @@
 
 #include <opencv2/opencv.hpp>
 #include "condens.h"
+#include "integral_hist.h"
+#include "hist.h"
 
 class ParticleFilter : private ConDensation
 {
@@ -36,7 +38,21 @@ public:
       NUM_STATES
    };
 
-   ParticleFilter(int num_particles);
+   /**
+    * How the particle histograms are computed: counted over the region of
+    * each particle, or looked up in an integral histogram built over the
+    * bounding box of the particle cloud.  HIST_AUTO picks the cheaper one
+    * for each frame.
+    */
+   enum HistogramMode
+   {
+      HIST_AUTO,
+      HIST_DIRECT,
+      HIST_INTEGRAL
+   };
+
+   // Storage for max_particles, for the adaptive count of set_adaptive
+   ParticleFilter(int num_particles, int max_particles = 0);
    virtual ~ParticleFilter();
 
    void init(const cv::Rect& selection);
@@ -49,6 +65,38 @@ public:
 
    void redistribute(const float lower_bound[], const float upper_bound[]);
 
+   // Part of the frame the next update reads, see filter.cpp
+   cv::Rect search_window(const cv::Size& target_size, const cv::Size& frame_size, double margin) const;
+
+   // The integral histogram is only built with at most max_entries counts
+   void set_histogram_mode(HistogramMode mode, double max_entries = 1 << 24)
+   { m_hist_mode = mode; m_integral_limit = max_entries; }
+
+   // Count the joint colour and LBP histograms as sparse histograms (default)
+   // instead of dense ones, when they are not looked up in the integral histogram
+   void set_sparse_lbp(bool sparse)
+   { m_sparse_lbp = sparse; }
+
+   // True if the last update looked the histograms up in the integral histogram
+   bool used_integral() const
+   { return m_used_integral; }
+
+   // Adapt the number of particles between min_particles and the maximum
+   // of the constructor by KLD-sampling, see ConDensation::set_adaptive
+   void set_adaptive(unsigned int min_particles, float epsilon = 0.05f);
+
+   // Duration of the last update, in milliseconds
+   double update_ms() const
+   { return m_update_ms; }
+
+   using ConDensation::set_resampling;
+   using ConDensation::adaptive;
+   using ConDensation::num_particles;
+   using ConDensation::max_particles;
+   using ConDensation::occupied_bins;
+   using ConDensation::effective_sample_size;
+   using ConDensation::resampled;
+
    const cv::Mat& state() const
    { return m_state; }
 
@@ -57,9 +105,26 @@ public:
 
 private:
    
-   float calc_likelyhood(cv::Mat& image_roi, cv::Mat& lbp_roi, cv::Mat& target_hist, bool use_lbp );
+   float calc_likelyhood(const cv::Rect& region, bool use_lbp, int scratch );
+
+   bool choose_integral(const cv::Rect& bounds, int num_bins);
+
+   static cv::Rect region_of(float x, float y, float scale, const cv::Size& target_size);
 
    float m_mean_confidence;
+   cv::Mat m_bins;                   // Histogram bin of the pixels the update reads, see calc_bin_map
+   std::vector<cv::Rect> m_regions;  // Region of each particle in the frame
+   IntegralHistogram m_integral;
+   HistogramMode m_hist_mode;
+   double m_integral_limit;
+   bool m_used_integral;
+   std::vector<cv::Mat> m_scratch;   // Histogram scratch of each stripe of particles
+   std::vector<SparseHist> m_sparse; // Same, for the sparse histograms
+   bool m_sparse_lbp;
+   cv::Mat m_sqrt_target;            // Square roots of the target bins
+   double m_target_sum;
+   bool m_redistributed;             // The particles were spread over the frame since the last update
+   double m_update_ms;               // Duration of the last update, ms
    
 
 
@@ -18,6 +18,7 @@
  */
 #include "hist.h"
 #include "lbp.h"
+#include <opencv2/core/hal/intrin.hpp>
 
 using namespace cv;
 using namespace std;
@@ -71,3 +72,146 @@ void calc_hist(cv::Mat& bgr, cv::Mat& lbp, cv::Mat& hist, bool use_lbp)
       return calc_hist_bgr(bgr, lbp, hist);
    }
 }
+
+void calc_bin_map(const Mat& bgr, const Mat& lbp, Mat& bins, bool use_lbp)
+{
+   calc_bin_map(bgr, lbp, bins, use_lbp, Rect(0, 0, bgr.cols, bgr.rows));
+}
+
+void calc_bin_map(const Mat& bgr, const Mat& lbp, Mat& bins, bool use_lbp, const Rect& window)
+{
+   CV_Assert(bgr.type() == CV_8UC3 && (!use_lbp || (lbp.type() == CV_8UC1 && lbp.size() == bgr.size())));
+
+   // Per channel offset of each value in the flat histogram.  The values
+   // left out by calcHist get an offset past the last bin, so that a single
+   // comparison of the sum finds them.
+   const int l_bins = use_lbp ? lbp_num_patterns() : 1;
+   const int num_bins = hist_num_bins(use_lbp);
+   const int NONE = 4 * num_bins;
+   int b_offset[256], g_offset[256], r_offset[256], l_offset[256];
+   for( int v = 0; v < 256; v++ )
+   {
+      int bin = v * 8 / 255;   // calcHist binning of the range [0, 255)
+      b_offset[v] = bin < 8 ? bin * 64 * l_bins : NONE;
+      g_offset[v] = bin < 8 ? bin * 8 * l_bins : NONE;
+      r_offset[v] = bin < 8 ? bin * l_bins : NONE;
+      l_offset[v] = v < l_bins ? v : NONE;
+   }
+
+   bins.create(bgr.size(), CV_16UC1);
+   const Rect roi = window & Rect(0, 0, bgr.cols, bgr.rows);
+   if( roi.empty() )
+      return;
+   parallel_for_(Range(roi.y, roi.y + roi.height), [&](const Range& rows)
+   {
+      for( int y = rows.start; y < rows.end; y++ )
+      {
+	 const uchar* p = bgr.ptr<uchar>(y) + 3 * roi.x;
+	 const uchar* l = use_lbp ? lbp.ptr<uchar>(y) : 0;
+	 ushort* out = bins.ptr<ushort>(y);
+	 for( int x = roi.x; x < roi.x + roi.width; x++, p += 3 )
+	 {
+	    int bin = b_offset[p[0]] + g_offset[p[1]] + r_offset[p[2]] + (l ? l_offset[l[x]] : 0);
+	    out[x] = bin < num_bins ? (ushort)bin : HIST_BIN_NONE;
+	 }
+      }
+   }, roi.area() / (double)(1 << 16));
+}
+
+int hist_num_bins(bool use_lbp)
+{
+   return 8 * 8 * 8 * (use_lbp ? lbp_num_patterns() : 1);
+}
+
+void create_hist(Mat& hist, bool use_lbp)
+{
+   const int sizes[] = {8, 8, 8, (int)lbp_num_patterns()};
+   const int dims = use_lbp ? 4 : 3;
+   hist.create(dims, sizes, CV_32F);
+}
+
+void calc_hist_bins(const Mat& bins, Mat& hist, bool use_lbp)
+{
+   create_hist(hist, use_lbp);
+   hist = Scalar::all(0);
+
+   float* h = hist.ptr<float>();
+   for( int y = 0; y < bins.rows; y++ )
+   {
+      const ushort* b = bins.ptr<ushort>(y);
+      for( int x = 0; x < bins.cols; x++ )
+      {
+	 if( b[x] != HIST_BIN_NONE )
+	    h[b[x]] += 1.f;
+      }
+   }
+}
+
+void calc_sparse_hist_bins(const Mat& bins, SparseHist& hist, int num_bins)
+{
+   if( (int)hist.counts.size() != num_bins )
+   {
+      hist.counts.assign(num_bins, 0.f);
+      hist.bins.clear();
+      hist.bins.reserve(num_bins);
+   }
+
+   float* counts = &hist.counts[0];
+   int total = 0;
+   for( int y = 0; y < bins.rows; y++ )
+   {
+      const ushort* b = bins.ptr<ushort>(y);
+      for( int x = 0; x < bins.cols; x++ )
+      {
+	 if( b[x] == HIST_BIN_NONE )
+	    continue;
+	 if( counts[b[x]] == 0.f )
+	    hist.bins.push_back(b[x]);
+	 counts[b[x]] += 1.f;
+	 total++;
+      }
+   }
+   hist.sum = total;
+}
+
+double bhattacharyya_coeff(const float* hist, const float* sqrt_target, int num_bins, double target_sum)
+{
+   int i = 0;
+   float sum = 0.f, dot = 0.f;
+#if CV_SIMD
+   v_float32 vsum = vx_setzero_f32(), vdot = vx_setzero_f32();
+   for( ; i <= num_bins - v_float32::nlanes; i += v_float32::nlanes )
+   {
+      v_float32 h = vx_load(hist + i);
+      vsum += h;
+      vdot = v_fma(v_sqrt(h), vx_load(sqrt_target + i), vdot);
+   }
+   sum = v_reduce_sum(vsum);
+   dot = v_reduce_sum(vdot);
+   vx_cleanup();
+#endif
+   for( ; i < num_bins; i++ )
+   {
+      sum += hist[i];
+      dot += std::sqrt(hist[i]) * sqrt_target[i];
+   }
+
+   double s = sum * target_sum;
+   return fabs(s) > FLT_EPSILON ? dot / std::sqrt(s) : 0.;
+}
+
+double sparse_bhattacharyya_coeff(SparseHist& hist, const float* sqrt_target, double target_sum)
+{
+   double dot = 0;
+   for( size_t i = 0; i < hist.bins.size(); i++ )
+   {
+      int b = hist.bins[i];
+      dot += std::sqrt(hist.counts[b]) * sqrt_target[b];
+      hist.counts[b] = 0.f;
+   }
+   hist.bins.clear();
+
+   double s = hist.sum * target_sum;
+   hist.sum = 0;
+   return fabs(s) > FLT_EPSILON ? dot / std::sqrt(s) : 0.;
+}
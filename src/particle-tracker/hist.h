@@ -20,7 +20,67 @@
  */
 
 #include <opencv2/opencv.hpp>
+#include <vector>
 
 void calc_hist(cv::Mat& bgr, cv::Mat& lbp, cv::Mat& hist, bool use_lbp);
 
+/**
+ * Bin index map of a frame, computed once so that the histogram of any
+ * region is a count over the map instead of a calcHist over the pixels.
+ * Each CV_16UC1 entry is the bin of the pixel in the histogram of calc_hist,
+ * (b * 8 + g) * 8 + r with the LBP pattern folded in as the last dimension
+ * when use_lbp is set, or HIST_BIN_NONE for the pixels calc_hist leaves out
+ * (a channel at 255, an LBP pattern out of range).
+ */
+static const unsigned short HIST_BIN_NONE = 0xffff;
+
+void calc_bin_map(const cv::Mat& bgr, const cv::Mat& lbp, cv::Mat& bins, bool use_lbp);
+
+// Same over window only, bins keeps the frame size and the entries outside
+// window are left as they are
+void calc_bin_map(const cv::Mat& bgr, const cv::Mat& lbp, cv::Mat& bins, bool use_lbp, const cv::Rect& window);
+
+// Number of bins of the calc_hist histogram, and a histogram of its shape
+int hist_num_bins(bool use_lbp);
+
+void create_hist(cv::Mat& hist, bool use_lbp);
+
+/**
+ * Histogram of a region of the bin map, with the shape and values of
+ * calc_hist on the same region of the frame.
+ */
+void calc_hist_bins(const cv::Mat& bins, cv::Mat& hist, bool use_lbp);
+
+/**
+ * Sparse histogram of a region of the bin map, for the joint colour and LBP
+ * histogram whose thousands of bins are mostly empty over a particle.  The
+ * counts are kept in a dense array that stays at zero outside the list of
+ * non-empty bins, so neither building nor comparing it touches the empty
+ * bins, and it is cleared by the comparison.
+ */
+struct SparseHist
+{
+   SparseHist() : sum(0) {}
+
+   std::vector<float> counts;
+   std::vector<int> bins;      // Non-empty bins, in the order first seen
+   double sum;
+};
+
+void calc_sparse_hist_bins(const cv::Mat& bins, SparseHist& hist, int num_bins);
+
+/**
+ * Bhattacharyya coefficient sum(sqrt(h * t)) / sqrt(sum(h) * sum(t)) between
+ * an unnormalized histogram and a target given by the square roots of its
+ * bins and its sum, 0 for an empty histogram.  compareHist with
+ * HISTCMP_BHATTACHARYYA gives sqrt(1 - coefficient), without the need to
+ * normalize the histograms first.
+ *
+ * The dense version is a single vectorized pass accumulating the sum and the
+ * products, the sparse one only reads the non-empty bins and leaves hist empty.
+ */
+double bhattacharyya_coeff(const float* hist, const float* sqrt_target, int num_bins, double target_sum);
+
+double sparse_bhattacharyya_coeff(SparseHist& hist, const float* sqrt_target, double target_sum);
+
 #endif
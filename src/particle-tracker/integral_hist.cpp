@@ -0,0 +1,83 @@
+/**
+ * @copyright
+ *
+ * Copyright 2012 Kevin Schluff
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "integral_hist.h"
+
+using namespace cv;
+using namespace std;
+
+IntegralHistogram::IntegralHistogram()
+   :m_region(),
+    m_num_bins(0),
+    m_sums()
+{}
+
+void IntegralHistogram::build(const Mat& bins, const Rect& region, int num_bins)
+{
+   CV_Assert(bins.type() == CV_16UC1 && num_bins > 0 &&
+	     (region & Rect(0, 0, bins.cols, bins.rows)) == region);
+
+   m_region = region;
+   m_num_bins = num_bins;
+   const size_t stride = (size_t)(region.width + 1) * num_bins;
+   m_sums.assign(stride * (region.height + 1), 0);
+
+   // Cumulative counts along each row, the rows in parallel.  The first row
+   // and column stay at zero.
+   parallel_for_(Range(0, region.height), [&](const Range& rows)
+   {
+      for( int y = rows.start; y < rows.end; y++ )
+      {
+	 const ushort* src = bins.ptr<ushort>(region.y + y) + region.x;
+	 int* row = &m_sums[(y + 1) * stride];
+	 for( int x = 0; x < region.width; x++ )
+	 {
+	    int* prev = row + x * num_bins;
+	    int* cur = prev + num_bins;
+	    std::copy(prev, cur, cur);
+	    if( src[x] < num_bins )
+	       cur[src[x]]++;
+	 }
+      }
+   }, region.area() * (double)num_bins / (1 << 16));
+
+   // Then down the columns, each stripe of a row in parallel
+   parallel_for_(Range(0, (int)stride), [&](const Range& cols)
+   {
+      for( int y = 1; y < region.height; y++ )
+      {
+	 const int* prev = &m_sums[y * stride];
+	 int* cur = &m_sums[(y + 1) * stride];
+	 for( int k = cols.start; k < cols.end; k++ )
+	    cur[k] += prev[k];
+      }
+   }, region.area() * (double)num_bins / (1 << 16));
+}
+
+void IntegralHistogram::lookup(const Rect& rect, float* hist) const
+{
+   const int x0 = rect.x - m_region.x, y0 = rect.y - m_region.y;
+   const int x1 = x0 + rect.width, y1 = y0 + rect.height;
+   const int* a = cell(y0, x0);
+   const int* b = cell(y0, x1);
+   const int* c = cell(y1, x0);
+   const int* d = cell(y1, x1);
+
+   for( int k = 0; k < m_num_bins; k++ )
+      hist[k] = (float)(d[k] - b[k] - c[k] + a[k]);
+}
@@ -0,0 +1,75 @@
+#ifndef INTEGRAL_HIST_H
+#define INTEGRAL_HIST_H
+/**
+ * @copyright
+ *
+ * Copyright 2012 Kevin Schluff
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * Integral histogram of a region of a bin map (see calc_bin_map): entry
+ * (y, x) holds the counts of every bin over the pixels above and left of
+ * (y, x) in the region.  Building it costs O(area * bins), after which the
+ * histogram of any rectangle inside the region costs O(bins), four lookups
+ * per bin, whatever its area.
+ *
+ * The counts are int, laid out [y][x][bin] so a lookup reads four contiguous
+ * runs.  The memory is (width + 1) * (height + 1) * bins * 4 bytes, which
+ * limits it to small bin counts or regions.
+ */
+class IntegralHistogram
+{
+public:
+
+   IntegralHistogram();
+
+   // Cumulative counts of the num_bins bins of bins (CV_16UC1) over region,
+   // the pixels at HIST_BIN_NONE are not counted
+   void build(const cv::Mat& bins, const cv::Rect& region, int num_bins);
+
+   // Empty rects are not contained, the clipping of a region outside the
+   // frame gives Rect() whatever the position of the region
+   bool contains(const cv::Rect& rect) const
+   { return !m_sums.empty() && !rect.empty() && (rect & m_region) == rect; }
+
+   // Counts of rect, in frame coordinates and contained in the region, into
+   // the num_bins floats of hist
+   void lookup(const cv::Rect& rect, float* hist) const;
+
+   const cv::Rect& region() const
+   { return m_region; }
+
+   int num_bins() const
+   { return m_num_bins; }
+
+   // Number of counts of an integral histogram over a region of size
+   static double entries(const cv::Size& size, int num_bins)
+   { return (double)(size.width + 1) * (size.height + 1) * num_bins; }
+
+private:
+
+   const int* cell(int y, int x) const
+   { return &m_sums[((size_t)y * (m_region.width + 1) + x) * m_num_bins]; }
+
+   cv::Rect m_region;
+   int m_num_bins;
+   std::vector<int> m_sums;
+};
+
+#endif
@@ -21,6 +21,8 @@
 using namespace cv;
 using namespace std;
 #include "lbp.h"
+#include "../../include/img_corr.h"
+#include <opencv2/core/hal/intrin.hpp>
 #include <cstring> // for memset
 
 typedef unsigned int uint;
@@ -30,6 +32,7 @@ typedef unsigned int uint;
 #endif
 
 static uchar lbp_lookup[UCHAR_MAX+1];
+static uchar lbp_rotated_lookup[UCHAR_MAX+1];  // lbp_lookup of the rotated patterns
 static uchar LBP_PATTERN_COUNT = 0;
 
 void lbp_init(bool uniform)
@@ -85,6 +88,18 @@ void lbp_init(bool uniform)
    lbp_lookup[0x09] = 34; // 0000 1001 = 34
    lbp_lookup[0x11] = 35; // 0001 0001 = 35
 
+   // Fold the rotation of lbp() into the table, so a raw pattern is a single lookup
+   for( uint pattern = 0; pattern <= UCHAR_MAX; pattern++ )
+   {
+      uint rotated = pattern;
+      if( rotated != 0 )
+      {
+	 while( (rotated & 0x1) == 0 )
+	    rotated >>= 1;
+      }
+      lbp_rotated_lookup[pattern] = lbp_lookup[rotated];
+   }
+
    cout << "LBP initialized " << (int)LBP_PATTERN_COUNT << endl;
 }
 
@@ -124,7 +139,114 @@ inline uchar lbp(const Mat& image, int x, int y)
 }
 
 
+// Raw pattern of the pixel at x of the row mid, before the rotation.  As in
+// lbp(), the threshold wraps around for the centre values above 251.
+static inline uchar lbp_pattern(const uchar* up, const uchar* mid, const uchar* down, int x)
+{
+   uchar v = mid[x] + 4;
+
+   return
+      (up  [x-1] > v ? 1 << 7 : 0)  |
+      (mid [x-1] > v ? 1 << 6 : 0)  |
+      (down[x-1] > v ? 1 << 5 : 0)  |
+      (down[x  ] > v ? 1 << 4 : 0)  |
+      (down[x+1] > v ? 1 << 3 : 0)  |
+      (mid [x+1] > v ? 1 << 2 : 0)  |
+      (up  [x+1] > v ? 1 << 1 : 0)  |
+      (up  [x  ] > v ? 1 << 0 : 0) ;
+}
+
+/**
+ * LBP of every pixel of a CV_8UC1 image.  The raw patterns of a row are
+ * computed a vector at a time with unsigned comparisons of the neighbour rows,
+ * then mapped through lbp_rotated_lookup with the table kernels of
+ * img_corr.h.  The rows are processed in parallel.  The border rows and
+ * columns, without all their neighbours, get lbp_num_patterns(), which the
+ * histograms leave out.
+ */
 void lbp_from_gray(const Mat& src, Mat& dst)
+{
+   CV_Assert(src.type() == CV_8UC1);
+   dst.create(src.size(), CV_8UC1);
+
+   const uchar border = LBP_PATTERN_COUNT;
+   if( src.rows < 3 || src.cols < 3 )
+   {
+      dst = Scalar::all(border);
+      return;
+   }
+   dst.row(0) = Scalar::all(border);
+   dst.row(dst.rows - 1) = Scalar::all(border);
+
+   LutRowKernel kernel = lut_kernel(lut_best_path());
+   const int cols = src.cols;
+   parallel_for_(Range(1, src.rows - 1), [&](const Range& rows)
+   {
+      for( int y = rows.start; y < rows.end; y++ )
+      {
+	 const uchar* up = src.ptr<uchar>(y - 1);
+	 const uchar* mid = src.ptr<uchar>(y);
+	 const uchar* down = src.ptr<uchar>(y + 1);
+	 uchar* out = dst.ptr<uchar>(y);
+	 out[0] = out[cols - 1] = border;
+
+	 int x = 1;
+#if CV_SIMD
+	 const v_uint8 four = vx_setall_u8(4);
+	 for( ; x <= cols - 1 - v_uint8::nlanes; x += v_uint8::nlanes )
+	 {
+	    v_uint8 v = v_add_wrap(vx_load(mid + x), four);
+	    v_uint8 pattern =
+	       ((vx_load(up   + x - 1) > v) & vx_setall_u8(1 << 7)) |
+	       ((vx_load(mid  + x - 1) > v) & vx_setall_u8(1 << 6)) |
+	       ((vx_load(down + x - 1) > v) & vx_setall_u8(1 << 5)) |
+	       ((vx_load(down + x    ) > v) & vx_setall_u8(1 << 4)) |
+	       ((vx_load(down + x + 1) > v) & vx_setall_u8(1 << 3)) |
+	       ((vx_load(mid  + x + 1) > v) & vx_setall_u8(1 << 2)) |
+	       ((vx_load(up   + x + 1) > v) & vx_setall_u8(1 << 1)) |
+	       ((vx_load(up   + x    ) > v) & vx_setall_u8(1 << 0));
+	    v_store(out + x, pattern);
+	 }
+	 vx_cleanup();
+#endif
+	 for( ; x < cols - 1; x++ )
+	 {
+	    out[x] = lbp_pattern(up, mid, down, x);
+	 }
+
+	 kernel(out + 1, out + 1, cols - 2, lbp_rotated_lookup);
+      }
+   }, src.total() / (double)(1 << 16));
+}
+
+/**
+ * LBP of a window of a BGR frame, into the frame sized lbp_image whose other
+ * pixels are kept from the previous calls.  The grey image is only computed
+ * over the window and the pixel around it, that the LBP needs.  That ring gets
+ * the border value, as the frame border.  gray is a scratch, lbp_image is
+ * (re)initialized to the border value when the frame size changes.
+ */
+Rect lbp_from_bgr_window(const Mat& bgr, const Rect& window, Mat& gray, Mat& lbp_image)
+{
+   if( lbp_image.size() != bgr.size() || lbp_image.type() != CV_8UC1 )
+   {
+      lbp_image.create(bgr.size(), CV_8UC1);
+      lbp_image = Scalar::all(LBP_PATTERN_COUNT);
+   }
+
+   Rect src_window = Rect(window.x - 1, window.y - 1, window.width + 2, window.height + 2) &
+      Rect(0, 0, bgr.cols, bgr.rows);
+   if( src_window.empty() )
+      return src_window;
+
+   cvtColor(bgr(src_window), gray, COLOR_BGR2GRAY);
+   Mat lbp_window = lbp_image(src_window);   // Written in place, same size and type
+   lbp_from_gray(gray, lbp_window);
+   return src_window;
+}
+
+// Former per-pixel computation, kept as the reference of lbp_from_gray
+void lbp_from_gray_reference(const Mat& src, Mat& dst)
 {
    dst.create(src.size(), CV_8UC1);
 
@@ -27,6 +27,13 @@ unsigned int lbp_num_patterns();
 
 void lbp_from_gray(const cv::Mat& image, cv::Mat& lbp_image);
 
+// LBP of a window of a BGR frame into the frame sized lbp_image, returns the
+// part of lbp_image written
+cv::Rect lbp_from_bgr_window(const cv::Mat& bgr, const cv::Rect& window, cv::Mat& gray, cv::Mat& lbp_image);
+
+// Per-pixel version, the border is left as is, for checking lbp_from_gray
+void lbp_from_gray_reference(const cv::Mat& image, cv::Mat& lbp_image);
+
 cv::Mat lbp_histogram(const cv::Mat& lbp_image, const cv::Rect& selection, bool norm = true);
 
 
@@ -25,6 +25,7 @@
 #include "selector.h"
 #include "state.h"
 #include "hist.h"
+#include "../../include/preproc.h"
 #include <cmath>
 #include <sys/time.h>
 #include <unistd.h> // For getopt
@@ -49,6 +50,9 @@ const Scalar BLACK = Scalar(0, 0, 0);
 
 const uint NUM_PARTICLES = 200;
 
+// Margin of the LBP window around the particles, in target sizes
+const double LBP_MARGIN = 0.5;
+
 inline void update_target_histogram(Mat& image, Mat& lbp_image, Rect& selection, Mat& histogram, Mat& target, bool use_lbp)
 {
    Mat roi(image, selection), lbp_roi(lbp_image, selection);
@@ -74,7 +78,7 @@ inline void update_target_histogram(Mat& image, Mat& lbp_image, Rect& selection,
 
 struct StateData
 {
-   StateData(int num_particles, bool use_lbp_, string initframe_):
+   StateData(int num_particles, int max_particles, bool use_lbp_, string initframe_):
       image(),
       lbp(),
       target(),
@@ -84,7 +88,7 @@ struct StateData
       use_lbp(use_lbp_),
       paused(false),
       draw_particles(false),
-      filter(num_particles),
+      filter(num_particles, max_particles),
       initframe(initframe_)
    {};
 
@@ -183,6 +187,8 @@ State_ state_tracking(StateData& d)
 
    // Update particle filter
    d.filter.update(d.image, d.lbp, d.selection.size(), d.target_histogram, d.use_lbp);
+   if( d.filter.adaptive() )
+      cout << "Particles: " << d.filter.num_particles() << ", update: " << d.filter.update_ms() << " ms" << endl;
 
    Size target_size(d.target.cols, d.target.rows);
 
@@ -217,7 +223,11 @@ struct Options
        use_lbp(false),
        infile(),
        outfile(),
-       initframe()
+       initframe(),
+       preproc(),
+       resampling(ConDensation::RESAMPLE_SYSTEMATIC),
+       ess_fraction(0),
+       max_particles(0)
    {}
 
    int num_particles;
@@ -225,12 +235,16 @@ struct Options
    string infile;
    string outfile;
    string initframe;
+   string preproc;
+   ConDensation::ResampleMethod resampling;
+   float ess_fraction;
+   int max_particles;
 };
 
 void parse_command_line(int argc, char** argv, Options& o)
 {
    int c = -1;
-   while( (c = getopt(argc, argv, "lopb:")) != -1 )
+   while( (c = getopt(argc, argv, "lopb:e:r:E:a:")) != -1 )
    {
      switch(c)
      {
@@ -243,14 +257,35 @@ void parse_command_line(int argc, char** argv, Options& o)
 	 case 'p':
 	    o.num_particles = atoi(optarg);
 	    break;
+	 case 'e':
+	    o.preproc = optarg;
+	    break;
+	 case 'r':
+	    if( string(optarg) == "stratified" )
+	       o.resampling = ConDensation::RESAMPLE_STRATIFIED;
+	    else if( string(optarg) == "residual" )
+	       o.resampling = ConDensation::RESAMPLE_RESIDUAL;
+	    else
+	       o.resampling = ConDensation::RESAMPLE_SYSTEMATIC;
+	    break;
+	 case 'E':
+	    o.ess_fraction = atof(optarg);
+	    break;
+	 case 'a':
+	    o.max_particles = atoi(optarg);
+	    break;
 	 case 'b':
 	    o.initframe = optarg;
 	 default:
 	    cerr << "Usage: " << argv[0] << " [-o output_file] [-p num_particles] [-b frame]" 
-	    << " [-l] [input_file]" << endl << endl;
+	    << " [-e preprocessing] [-r resampling] [-E ess_fraction] [-a max_particles] [-l] [input_file]" << endl << endl;
 	    cerr << "\t-o output_file : Optional mjpeg output file" << endl;
 	    cerr << "\t-p num_particles: Number of particles (samples) to use, default is 200" << endl;
 	    cerr << "\t-b initial_frame: Initial frame of the object to track" << endl;
+	    cerr << "\t-e preprocessing: Frame enhancement before tracking, e.g. gamma=0.7,bc=1.2:10,denoise=3,downscale=2" << endl;
+	    cerr << "\t-r resampling: systematic (default), stratified or residual" << endl;
+	    cerr << "\t-E ess_fraction: Resample only when the effective sample size is below ess_fraction * num_particles" << endl;
+	    cerr << "\t-a max_particles: Adapt the number of particles between num_particles and max_particles" << endl;
 	    cerr << "\t-l: Use local binary patterns in histogram" << endl;
 	    cerr << "\tinput_file : Optional file to read, otherwise use camera" << endl;
 	    exit(1);
@@ -263,10 +298,13 @@ void parse_command_line(int argc, char** argv, Options& o)
    }
 
    cout << "Num particles: " << o.num_particles << endl;
+   if( o.max_particles > o.num_particles )
+      cout << "Max particles: " << o.max_particles << endl;
    cout << "Input file: " << o.infile << endl;
    cout << "Output file: " << o.outfile << endl;
    cout << "Init frame: " << o.initframe << endl;
    cout << "Use LBP: " << o.use_lbp << endl;
+   cout << "Preprocessing: " << o.preproc << endl;
 
 }
 
@@ -297,12 +335,19 @@ int main(int argc, char** argv)
       exit(2);
    }
 
+   Preproc pre;
+   if( !pre.parse(o.preproc) )
+   {
+      cerr << "Invalid preprocessing '" << o.preproc << "'" << endl;
+      exit(1);
+   }
+
    if( !o.outfile.empty() )
    {
       int fps = cap.get(CAP_PROP_FPS);
       int width = cap.get(CAP_PROP_FRAME_WIDTH);
       int height = cap.get(CAP_PROP_FRAME_HEIGHT);
-      writer.open(o.outfile, CV_FOURCC('j', 'p', 'e', 'g'), fps, Size(width, height));
+      writer.open(o.outfile, CV_FOURCC('j', 'p', 'e', 'g'), fps, pre.output_size(Size(width, height)));
       if( !writer.isOpened() )
       {
 	  cerr << "Could not open '" << o.outfile << "'" << endl;
@@ -315,10 +360,16 @@ int main(int argc, char** argv)
    namedWindow(WINDOW, WINDOW_FREERATIO | CV_NORMAL);
 
 
-   StateData d(o.num_particles, o.use_lbp, o.initframe);
+   StateData d(o.num_particles, o.max_particles, o.use_lbp, o.initframe);
+   d.filter.set_resampling(o.resampling, o.ess_fraction);
+   if( o.max_particles > o.num_particles )
+      d.filter.set_adaptive(o.num_particles);
    
    State state = state_start;
-   Mat frame, gray;
+   Mat frame, gray, enhanced;
+
+   // Without preprocessing the camera frame is flipped directly
+   Mat& input = pre.empty() ? frame : enhanced;
 
    lbp_init();
 
@@ -342,20 +393,26 @@ int main(int argc, char** argv)
 	    break;
 	 }
       }
+      // Preprocessing, its last pass writes directly into d.image
       if( use_camera )
       {
-	 flip(frame, d.image, 1);
+	 pre.process(frame, input);
+	 flip(input, d.image, 1);
       }
       else
       {
-	 frame.copyTo(d.image);
+	 pre.process(frame, d.image);
       }
       
       // Set up all the image formats we'll need
       if(d.use_lbp)
       {
-	 cvtColor(d.image, gray, COLOR_BGR2GRAY);
-	 lbp_from_gray(gray, d.lbp);
+	 // While tracking, only around the particles the next update reads,
+	 // the whole frame otherwise and after a redistribution
+	 Rect window(0, 0, d.image.cols, d.image.rows);
+	 if( state == state_tracking )
+	    window = d.filter.search_window(d.selection.size(), d.image.size(), LBP_MARGIN);
+	 lbp_from_bgr_window(d.image, window, gray, d.lbp);
       }
       else
       {
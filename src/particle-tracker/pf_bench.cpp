@@ -0,0 +1,530 @@
+/**
+ * Benchmark and checks of the particle filter:
+ *
+ * - the resampling of ConDensation::time_update for particle counts from 100
+ *   to 100k, against the former O(N^2) loop.  Systematic and stratified
+ *   resampling must give every particle floor or ceil of its expected number
+ *   of copies (N w / sum w) for systematic, residual at least the floor.
+ * - the KLD-adaptive particle count, which must stay within its bounds
+ *   without reallocating.
+ * - ParticleFilter::update on a synthetic frame for 1, 2, 4 ... threads, with
+ *   the same state whatever the number of threads.
+ * - the histograms counted over the bin map and looked up in an
+ *   IntegralHistogram, equal to calcHist on random regions, and update() with
+ *   each histogram mode for a small and a large target.
+ * - the dense and sparse Bhattacharyya kernels against compareHist, then a
+ *   textured target tracked with LBP, with dense and sparse histograms and
+ *   with the adaptive count, for the time and the tracking error.
+ * - lbp_from_gray bit-exact against the per-pixel reference in both LBP
+ *   modes, and the LBP of the search window of a filter against the full
+ *   frame one, on an HD frame.
+ *
+ * usage: ./pf_bench
+ */
+#include "condens.h"
+#include "filter.h"
+#include "hist.h"
+#include "integral_hist.h"
+#include "lbp.h"
+#include <iostream>
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+typedef unsigned int uint;
+
+class BenchDensation : public ConDensation
+{
+public:
+
+   BenchDensation(uint num_particles, uint max_particles = 0)
+      :ConDensation(NUM_STATES, num_particles, max_particles)
+   {
+      static const float initial[NUM_STATES] = {320, 240, 0, 0, 1};
+      static const float std_dev[NUM_STATES] = {2, 2, .5, .5, .1};
+      m_transition_matrix = (Mat_<float>(NUM_STATES, NUM_STATES) <<
+				     1, 0, 1, 0, 0,
+				     0, 1, 0, 1, 0,
+				     0, 0, 1, 0, 0,
+				     0, 0, 0, 1, 0,
+				     0, 0, 0, 0, 1);
+      init_sample_set(initial, std_dev);
+   }
+
+   // Both particle buffers, which must not move
+   pair<const uchar*, const uchar*> storage() const
+   {
+      return make_pair(m_particles.data, m_new_particles.data);
+   }
+
+   // Peaked weights, as when the target is found: most particles are unlikely
+   void set_weights(RNG& rng)
+   {
+      for( uint i = 0; i < m_num_particles; i++ )
+      {
+	 float d = rng.uniform(0.f, 3.f);
+	 m_confidence[i] = exp(-d * d);
+      }
+   }
+
+   // The loop replaced by the single forward walk
+   double legacy_resampling_ms()
+   {
+      float sum = 0;
+      for( uint i = 0; i < m_num_particles; i++ )
+      {
+	 sum += m_confidence[i];
+	 m_cumulative[i] = sum;
+      }
+      float mean_confidence = sum / m_num_particles;
+
+      int64 start = getTickCount();
+      for( uint i = 0; i < m_num_particles; i++ )
+      {
+	 uint j = 0;
+	 while( (m_cumulative[j] <= (float) i * mean_confidence) && ( j < m_num_particles-1) )
+	 {
+	    j++;
+	 }
+	 m_resampled[i] = j;
+      }
+      return 1000.0 * (getTickCount() - start) / getTickFrequency();
+   }
+
+   // Copies of each particle against its expected count, weights as before the update
+   bool check_counts(const vector<float>& weights, ResampleMethod method)
+   {
+      vector<int> copies(m_num_particles, 0);
+      for( uint i = 0; i < m_num_particles; i++ )
+      {
+	 copies[m_resampled[i]]++;
+      }
+
+      double sum = 0;
+      for( uint i = 0; i < m_num_particles; i++ )
+	 sum += weights[i];
+
+      for( uint i = 0; i < m_num_particles; i++ )
+      {
+	 double expected = m_num_particles * weights[i] / sum;
+	 double slack = 1e-6;
+	 bool ok = method == RESAMPLE_SYSTEMATIC ? copies[i] >= floor(expected - slack) && copies[i] <= ceil(expected + slack)
+	         : method == RESAMPLE_RESIDUAL ? copies[i] >= floor(expected - slack)
+	         : true;
+	 if( !ok )
+	    return false;
+      }
+      return true;
+   }
+
+   const vector<float>& weights() const
+   { return m_confidence; }
+
+   enum { NUM_STATES = 5 };
+};
+
+int main()
+{
+   const uint counts[] = {100, 1000, 10000, 100000};
+   const char* names[] = {"systematic", "stratified", "residual"};
+   const int n_runs = 20;
+   bool ok = true;
+
+   for( uint c = 0; c < sizeof(counts) / sizeof(counts[0]); c++ )
+   {
+      uint n = counts[c];
+      RNG rng(n);
+      cout << n << " particles:";
+
+      if( n <= 10000 )
+      {
+	 BenchDensation legacy(n);
+	 legacy.set_weights(rng);
+	 cout << " O(N^2) resampling " << legacy.legacy_resampling_ms() << "ms,";
+      }
+      else
+      {
+	 cout << " O(N^2) resampling skipped,";
+      }
+
+      for( int m = 0; m < 3; m++ )
+      {
+	 BenchDensation filter(n);
+	 filter.set_resampling((ConDensation::ResampleMethod) m, 0);
+
+	 double total_ms = 0;
+	 bool counts_ok = true;
+	 for( int r = 0; r < n_runs; r++ )
+	 {
+	    filter.set_weights(rng);
+	    vector<float> weights = filter.weights();
+	    int64 start = getTickCount();
+	    filter.time_update();
+	    total_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+	    counts_ok = counts_ok && filter.check_counts(weights, (ConDensation::ResampleMethod) m);
+	 }
+	 ok = ok && counts_ok;
+	 cout << " " << names[m] << " update " << total_ms / n_runs << "ms"
+	      << (counts_ok ? "" : " (BAD COUNTS)") << (m < 2 ? "," : "");
+      }
+      cout << endl;
+   }
+
+   // Effective sample size trigger: with flat weights resampling is skipped
+   BenchDensation filter(1000);
+   filter.set_resampling(ConDensation::RESAMPLE_SYSTEMATIC, 0.5);
+   filter.time_update();
+   cout << "ESS " << filter.effective_sample_size() << " of 1000 with uniform weights, resampled: "
+	<< filter.resampled() << endl;
+   ok = ok && !filter.resampled();
+
+   // KLD-sampling: the count follows the spread of the weights without
+   // reallocating, within its bounds
+   {
+      static const float bin_size[] = {4, 4, 1, 1, .05};
+      BenchDensation filter(100, 20000);
+      filter.set_adaptive(100, bin_size);
+      filter.set_resampling(ConDensation::RESAMPLE_SYSTEMATIC, 0);
+      pair<const uchar*, const uchar*> storage = filter.storage();
+      RNG kld_rng(7);
+      bool bounded = true;
+      cout << "KLD-sampling, particles:";
+      for( int step = 0; step < 10; step++ )
+      {
+	 filter.set_weights(kld_rng);
+	 filter.time_update();
+	 bounded = bounded && filter.num_particles() >= 100 && filter.num_particles() <= 20000;
+	 cout << " " << filter.num_particles() << " (" << filter.occupied_bins() << " bins)";
+      }
+      bool kept = filter.storage() == storage;
+      ok = ok && bounded && kept;
+      cout << (bounded ? "" : ", OUT OF BOUNDS") << (kept ? ", no reallocation" : ", REALLOCATED") << endl;
+   }
+
+   // Likelihood evaluation against the number of threads
+   RNG rng(42);
+   Mat image(720, 1280, CV_8UC3);
+   rng.fill(image, RNG::UNIFORM, 0, 256);
+   GaussianBlur(image, image, Size(9, 9), 0);
+   Mat lbp = Mat::zeros(image.rows, image.cols, CV_8UC1);
+   lbp_init();
+
+   // Bin map histograms against calcHist, with LBP values partly out of range
+   Mat lbp_random(image.rows, image.cols, CV_8UC1);
+   rng.fill(lbp_random, RNG::UNIFORM, 0, lbp_num_patterns() + 2);
+   for( int use_lbp = 0; use_lbp < 2; use_lbp++ )
+   {
+      Mat bins, ref, hist;
+      calc_bin_map(image, lbp_random, bins, use_lbp);
+      double calchist_ms = 0, bins_ms = 0;
+      bool same = true;
+      for( int r = 0; r < 500; r++ )
+      {
+	 Rect region(rng.uniform(0, image.cols - 200), rng.uniform(0, image.rows - 200),
+		     rng.uniform(1, 200), rng.uniform(1, 200));
+	 Mat image_roi(image, region), lbp_roi(lbp_random, region), bins_roi(bins, region);
+	 int64 start = getTickCount();
+	 calc_hist(image_roi, lbp_roi, ref, use_lbp);
+	 calchist_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+	 start = getTickCount();
+	 calc_hist_bins(bins_roi, hist, use_lbp);
+	 bins_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+	 same = same && ref.dims == hist.dims && ref.total() == hist.total() && norm(ref, hist, NORM_INF) == 0;
+      }
+      ok = ok && same;
+      cout << "500 histograms" << (use_lbp ? " with LBP" : "") << ": calcHist " << calchist_ms
+	   << "ms, bin map " << bins_ms << "ms" << (same ? ", identical" : ", MISMATCH") << endl;
+
+      // Bin map of a window, partly outside the frame, against the whole map
+      Rect window(1100, 500, 400, 300);
+      Mat window_bins(image.size(), CV_16UC1, Scalar::all(0));
+      calc_bin_map(image, lbp_random, window_bins, use_lbp, window);
+      Rect inside = window & Rect(0, 0, image.cols, image.rows);
+      same = norm(Mat(bins, inside), Mat(window_bins, inside), NORM_INF) == 0;
+      ok = ok && same;
+      cout << "bin map of a window" << (use_lbp ? " with LBP" : "")
+	   << (same ? ", identical" : ", MISMATCH") << endl;
+
+      // Integral histogram over a 400x300 box, against counting the bin map
+      Rect box(300, 200, 400, 300);
+      IntegralHistogram integral;
+      int64 start = getTickCount();
+      integral.build(bins, box, hist_num_bins(use_lbp));
+      double build_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
+      double lookup_ms = 0;
+      same = true;
+      for( int r = 0; r < 500; r++ )
+      {
+	 Rect region(box.x + rng.uniform(0, 200), box.y + rng.uniform(0, 150),
+		     rng.uniform(1, 200), rng.uniform(1, 150));
+	 calc_hist_bins(Mat(bins, region), ref, use_lbp);
+	 create_hist(hist, use_lbp);
+	 start = getTickCount();
+	 integral.lookup(region, hist.ptr<float>());
+	 lookup_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+	 same = same && integral.contains(region) && norm(ref, hist, NORM_INF) == 0;
+      }
+      ok = ok && same;
+      cout << "integral histogram of " << box.width << "x" << box.height << ": build " << build_ms
+	   << "ms, 500 lookups " << lookup_ms << "ms" << (same ? ", identical" : ", MISMATCH") << endl;
+   }
+
+   Rect selection(600, 320, 80, 80);
+   Mat roi(image, selection), lbp_roi(lbp, selection);
+   Mat target_hist;
+   calc_hist(roi, lbp_roi, target_hist, false);
+   normalize(target_hist, target_hist);
+
+   const int max_threads = getNumThreads();
+   const uint particle_counts[] = {200, 1000, 5000};
+   for( uint c = 0; c < sizeof(particle_counts) / sizeof(particle_counts[0]); c++ )
+   {
+      uint n = particle_counts[c];
+      double single_ms = 0;
+      Mat single_state;
+      cout << n << " particles, update:";
+      for( int threads = 1; threads <= max_threads; threads = threads < max_threads ? min(2 * threads, max_threads) : threads + 1 )
+      {
+	 setNumThreads(threads);
+	 ParticleFilter filter(n);
+	 filter.init(selection);
+	 int64 start = getTickCount();
+	 for( int r = 0; r < 10; r++ )
+	 {
+	    filter.update(image, lbp, selection.size(), target_hist, false);
+	 }
+	 double ms = 100.0 * (getTickCount() - start) / getTickFrequency();
+	 if( threads == 1 )
+	 {
+	    single_ms = ms;
+	    filter.state().copyTo(single_state);
+	 }
+	 bool same = norm(filter.state(), single_state, NORM_INF) == 0;
+	 ok = ok && same;
+	 cout << " " << threads << " threads " << ms << "ms (x" << single_ms / ms << ")"
+	      << (same ? "" : " STATE DIFFERS");
+      }
+      cout << endl;
+   }
+   setNumThreads(max_threads);
+
+   // Counted or integral histograms, for a small and a large target
+   const Size target_sizes[] = {Size(20, 20), Size(160, 160)};
+   const char* mode_names[] = {"auto", "direct", "integral"};
+   for( uint t = 0; t < sizeof(target_sizes) / sizeof(target_sizes[0]); t++ )
+   {
+      Rect target(Point(640 - target_sizes[t].width / 2, 360 - target_sizes[t].height / 2), target_sizes[t]);
+      Mat target_roi(image, target), target_lbp(lbp, target);
+      calc_hist(target_roi, target_lbp, target_hist, false);
+      normalize(target_hist, target_hist);
+
+      cout << "1000 particles, " << target.width << "x" << target.height << " target:";
+      for( int mode = ParticleFilter::HIST_AUTO; mode <= ParticleFilter::HIST_INTEGRAL; mode++ )
+      {
+	 ParticleFilter filter(1000);
+	 filter.set_histogram_mode((ParticleFilter::HistogramMode)mode);
+	 filter.init(target);
+	 int integral_frames = 0;
+	 int64 start = getTickCount();
+	 for( int r = 0; r < 10; r++ )
+	 {
+	    filter.update(image, lbp, target.size(), target_hist, false);
+	    integral_frames += filter.used_integral();
+	 }
+	 double ms = 100.0 * (getTickCount() - start) / getTickFrequency();
+	 cout << " " << mode_names[mode] << " " << ms << "ms (" << integral_frames << "/10 integral)";
+      }
+      cout << endl;
+   }
+
+   // Particles outside the frame have empty regions, which the integral
+   // histogram must not look up: the box of the cloud does not start at (0, 0)
+   {
+      static const float lower_bound[] = {-1500, 300, -.5, -.5, 1.0};
+      static const float upper_bound[] = {1000, 500, .5, .5, 2.0};
+      Rect target(600, 320, 80, 80);
+      Mat states[2];
+      for( int integral = 0; integral < 2; integral++ )
+      {
+	 ParticleFilter filter(1000);
+	 filter.set_histogram_mode(integral ? ParticleFilter::HIST_INTEGRAL : ParticleFilter::HIST_DIRECT);
+	 filter.init(target);
+	 filter.redistribute(lower_bound, upper_bound);
+	 filter.update(image, lbp, target.size(), target_hist, false);
+	 filter.state().copyTo(states[integral]);
+      }
+      bool same = norm(states[0], states[1], NORM_INF) == 0;
+      ok = ok && same;
+      cout << "particles outside the frame, integral against direct: " << (same ? "same state" : "STATE DIFFERS") << endl;
+   }
+
+   // Dense and sparse joint histograms with LBP: distance on random regions
+   Mat gray, lbp_image, bins;
+   cvtColor(image, gray, COLOR_BGR2GRAY);
+   lbp_from_gray(gray, lbp_image);
+   Rect lbp_target(600, 320, 60, 60);
+   Mat lbp_target_roi(image, lbp_target), lbp_target_lbp(lbp_image, lbp_target);
+   calc_hist(lbp_target_roi, lbp_target_lbp, target_hist, true);
+   normalize(target_hist, target_hist);
+   calc_bin_map(image, lbp_image, bins, true);
+   {
+      Mat dense, sqrt_target;
+      SparseHist sparse;
+      cv::sqrt(target_hist, sqrt_target);
+      const double target_sum = sum(target_hist)[0];
+      const int num_bins = hist_num_bins(true);
+      double dense_diff = 0, sparse_diff = 0;
+      double compare_ms = 0, coeff_ms = 0, sparse_ms = 0;
+      for( int r = 0; r < 500; r++ )
+      {
+	 Rect region(rng.uniform(0, image.cols - 100), rng.uniform(0, image.rows - 100),
+		     rng.uniform(0, 100), rng.uniform(0, 100));
+	 calc_hist_bins(Mat(bins, region), dense, true);
+
+	 // Squared distances, the coefficient is 1 - d^2
+	 int64 start = getTickCount();
+	 double coeff = bhattacharyya_coeff(dense.ptr<float>(), sqrt_target.ptr<float>(), num_bins, target_sum);
+	 coeff_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+
+	 start = getTickCount();
+	 normalize(dense, dense);
+	 double ref = compareHist(target_hist, dense, HISTCMP_BHATTACHARYYA);
+	 compare_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+
+	 start = getTickCount();
+	 calc_sparse_hist_bins(Mat(bins, region), sparse, num_bins);
+	 double sparse_coeff = sparse_bhattacharyya_coeff(sparse, sqrt_target.ptr<float>(), target_sum);
+	 sparse_ms += 1000.0 * (getTickCount() - start) / getTickFrequency();
+
+	 dense_diff = max(dense_diff, fabs(MAX(1 - coeff, 0.) - ref * ref));
+	 sparse_diff = max(sparse_diff, fabs(MAX(1 - sparse_coeff, 0.) - ref * ref));
+      }
+      ok = ok && dense_diff < 1e-4 && sparse_diff < 1e-4;
+      cout << "500 LBP histogram comparisons: normalize + compareHist " << compare_ms
+	   << "ms, bhattacharyya_coeff " << coeff_ms << "ms, sparse count + compare " << sparse_ms
+	   << "ms; max difference of d^2 to compareHist " << dense_diff << " dense, " << sparse_diff << " sparse" << endl;
+   }
+
+   // Track a textured square moving by (3, 2) pixels per frame
+   Mat texture(60, 60, CV_8UC3);
+   rng.fill(texture, RNG::UNIFORM, 0, 256);
+   // Dense, sparse, then sparse with 100 to 3000 particles chosen by KLD-sampling
+   for( int config = 0; config < 3; config++ )
+   {
+      const bool sparse = config > 0, adaptive = config == 2;
+      ParticleFilter filter(adaptive ? 100 : 1000, adaptive ? 3000 : 0);
+      filter.set_histogram_mode(ParticleFilter::HIST_DIRECT);
+      filter.set_sparse_lbp(sparse);
+      if( adaptive )
+	 filter.set_adaptive(100);
+      Rect truth(400, 250, 60, 60);
+      Mat frame, frame_gray, frame_lbp, model_hist;
+      image.copyTo(frame);
+      texture.copyTo(frame(truth));
+      cvtColor(frame, frame_gray, COLOR_BGR2GRAY);
+      lbp_from_gray(frame_gray, frame_lbp);
+      Mat model_roi(frame, truth), model_lbp(frame_lbp, truth);
+      calc_hist(model_roi, model_lbp, model_hist, true);
+      normalize(model_hist, model_hist);
+      filter.init(truth);
+
+      double update_ms = 0, error = 0, particles = 0;
+      const int frames = 40;
+      for( int f = 0; f < frames; f++ )
+      {
+	 truth.x += 3;
+	 truth.y += 2;
+	 image.copyTo(frame);
+	 texture.copyTo(frame(truth));
+	 cvtColor(frame, frame_gray, COLOR_BGR2GRAY);
+	 lbp_from_gray(frame_gray, frame_lbp);
+
+	 particles += filter.num_particles();
+	 const Mat& state = filter.update(frame, frame_lbp, truth.size(), model_hist, true);
+	 update_ms += filter.update_ms();
+	 error += norm(Point2f(state.at<float>(ParticleFilter::STATE_X), state.at<float>(ParticleFilter::STATE_Y)) -
+		       Point2f(truth.x + truth.width / 2, truth.y + truth.height / 2));
+      }
+      cout << (sparse ? "sparse" : "dense") << " LBP histograms" << (adaptive ? ", adaptive count" : "") << ": "
+	   << particles / frames << " particles and " << update_ms / frames << "ms per update, "
+	   << "mean position error " << error / frames << " pixels" << endl;
+
+      if( adaptive )
+      {
+	 // All the particles again to search the frame
+	 static const float lower_bound[] = {0, 0, -.5, -.5, 1.0};
+	 const float upper_bound[] = {(float)frame.cols, (float)frame.rows, .5, .5, 2.0};
+	 filter.redistribute(lower_bound, upper_bound);
+	 ok = ok && filter.num_particles() == filter.max_particles();
+	 cout << "after redistribute: " << filter.num_particles() << " particles" << endl;
+      }
+   }
+
+   // Vectorized LBP against the per-pixel reference, bright images wrap the threshold
+   const int lbp_widths[] = {3, 5, 17, 33, 64, 65, 100, 1280};
+   for( int uniform = 1; uniform >= 0; uniform-- )
+   {
+      lbp_init(uniform);
+      bool same = true;
+      for( uint w = 0; w < sizeof(lbp_widths) / sizeof(lbp_widths[0]); w++ )
+      {
+	 for( int bright = 0; bright < 2; bright++ )
+	 {
+	    Mat src(9, lbp_widths[w], CV_8UC1), ref, out;
+	    rng.fill(src, RNG::UNIFORM, bright ? 240 : 0, 256);
+	    lbp_from_gray_reference(src, ref);
+	    lbp_from_gray(src, out);
+	    Rect inner(1, 1, src.cols - 2, src.rows - 2);
+	    Mat border_mask(src.size(), CV_8UC1, Scalar::all(255));
+	    border_mask(inner) = Scalar::all(0);
+	    same = same && norm(ref(inner), out(inner), NORM_INF) == 0 &&
+	       countNonZero((out != (int)lbp_num_patterns()) & border_mask) == 0;
+	 }
+      }
+      ok = ok && same;
+
+      double ref_ms = 0, lbp_ms = 0;
+      Mat ref, out;
+      int64 start = getTickCount();
+      lbp_from_gray_reference(gray, ref);
+      ref_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
+      start = getTickCount();
+      lbp_from_gray(gray, out);
+      lbp_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
+      cout << (uniform ? "uniform" : "rotation invariant") << " LBP of " << gray.cols << "x" << gray.rows
+	   << ": per pixel " << ref_ms << "ms, vectorized " << lbp_ms << "ms" << (same ? ", bit-exact" : ", MISMATCH") << endl;
+   }
+   lbp_init();
+
+   // LBP over the search window of the particles against the full frame
+   {
+      Mat hd, hd_gray, full_lbp, window_lbp, scratch;
+      resize(image, hd, Size(1920, 1080));
+      Rect target(900, 500, 60, 60);
+      ParticleFilter filter(1000);
+      filter.init(target);
+      Mat target_roi(hd, target);
+      lbp_from_bgr_window(hd, Rect(0, 0, hd.cols, hd.rows), scratch, window_lbp);
+      Mat hd_target_lbp(window_lbp, target);
+      calc_hist(target_roi, hd_target_lbp, target_hist, true);
+      normalize(target_hist, target_hist);
+      filter.update(hd, window_lbp, target.size(), target_hist, true);
+
+      Rect window = filter.search_window(target.size(), hd.size(), 0.5);
+      int64 start = getTickCount();
+      cvtColor(hd, hd_gray, COLOR_BGR2GRAY);
+      lbp_from_gray(hd_gray, full_lbp);
+      double full_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
+      start = getTickCount();
+      lbp_from_bgr_window(hd, window, scratch, window_lbp);
+      double window_ms = 1000.0 * (getTickCount() - start) / getTickFrequency();
+
+      bool same = norm(full_lbp(window), window_lbp(window), NORM_INF) == 0;
+      ok = ok && same;
+      cout << "LBP of 1920x1080: full frame " << full_ms << "ms, search window " << window.width << "x"
+	   << window.height << " " << window_ms << "ms" << (same ? ", identical" : ", MISMATCH") << endl;
+   }
+
+   return ok ? 0 : 1;
+}
@@ -20,6 +20,13 @@
 #include <fstream>
 #include <ctime>
 #include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include "../include/annot_io.h"
+#include "../include/tracker_factory.h"
 
 
 using namespace std;
@@ -62,63 +69,290 @@ static vector<Rect2d> cutRect(const String videoname) {
     return bounds;
 }
 
-vector<Rect2d> read_box(String fname) {
+// where the box of a frame comes from, written in the .flags file for review
+enum BoxOrigin {
+    BOX_KEYFRAME = 'K',         // selected by the user
+    BOX_TRACKED = 'P',          // propagated by the trackers, to be reviewed
+    BOX_INTERPOLATED = 'I',     // both trackers lost, linear interpolation of the keyframes
+    BOX_MISSING = 'M'           // no box, to be annotated
+};
+
+struct PropagationJob {
+    size_t first;               // frame index of the first keyframe
+    vector<Mat> frames;         // frames from the first to the next keyframe, both included
+    Rect2d first_box;
+    Rect2d last_box;
+    bool closed;                // false for the frames after the last keyframe, which has no successor
+
+    PropagationJob() : first(0), closed(true) {}
+};
+
+static Rect2d blendRect(const Rect2d& a, const Rect2d& b, double w) {
+    return Rect2d((1 - w) * a.x + w * b.x, (1 - w) * a.y + w * b.y,
+                  (1 - w) * a.width + w * b.width, (1 - w) * a.height + w * b.height);
+}
+
+class Propagator {
 /*
- * Read the saved file (txt) into a list of Rect2d
- */ 
- 
-    ifstream fp;
-    fp.open(fname);
-    
-    vector<String> saved_box;
-    
-    String line;
-    while (getline(fp,line)) {
-        saved_box.push_back(line);
-    }    
-    fp.close();
+ * Background thread filling the frames between two keyframes while the user
+ * keeps selecting: a tracker is run forward from the first keyframe and another
+ * one backward from the second, and their boxes are blended with a weight
+ * growing linearly from the first keyframe to the second.  Each queued job
+ * holds its frames, so at most max_pending jobs are queued and push() waits
+ * for the thread to catch up beyond that.
+ */
+public:
+    Propagator(const string& trackername, vector<Rect2d>& bounds, vector<char>& origin,
+               size_t max_pending = 4)
+        : m_trackername(trackername), m_bounds(bounds), m_origin(origin),
+          m_max_pending(max(max_pending, (size_t) 1)), m_done(false) {
+        m_worker = thread(&Propagator::run, this);
+    }
 
-    vector<Rect2d> read;
-    int w, h, x, y;
-    for (vector<String>::iterator it = saved_box.begin();
-         it != saved_box.end(); it++) {
-         
-        sscanf((*it).c_str(), "[%d x %d from (%d, %d)]", &w, &h, &x, &y);
-        read.push_back(Rect2d(x,y,w,h));
+    ~Propagator() {
+        finish();
     }
-    
-    return read;
+
+    void push(PropagationJob& job) {
+        unique_lock<mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_jobs.size() < m_max_pending; });
+        m_jobs.push_back(PropagationJob());
+        swap(m_jobs.back(), job);
+        m_cond.notify_all();
+    }
+
+    void setKeyframe(size_t i, const Rect2d& box) {
+        lock_guard<mutex> lock(m_mutex);
+        m_bounds[i] = box;
+        m_origin[i] = BOX_KEYFRAME;
+    }
+
+    size_t pending() {
+        lock_guard<mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    // wait for all the queued jobs to be propagated
+    void finish() {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_done = true;
+            m_cond.notify_all();
+        }
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+
+private:
+    void run() {
+        for (;;) {
+            PropagationJob job;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] { return m_done || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                swap(job, m_jobs.front());
+                m_jobs.pop_front();
+                m_cond.notify_all();
+            }
+            propagate(job);
+        }
+    }
+
+    // run a tracker from frames[from] up to frames[to] excluded, ok[t] tells if boxes[t] is valid
+    void track(const PropagationJob& job, int from, int to, const Rect2d& initbox,
+               vector<Rect2d>& boxes, vector<bool>& ok) {
+        if (initbox.area() <= 0) {
+            return;
+        }
+        Ptr<Tracker> tracker = createTrackerType(m_trackername);
+        if (tracker.empty()) {
+            return;
+        }
+        tracker->init(job.frames[from], initbox);
+
+        const int step = from < to ? 1 : -1;
+        Rect2d box = initbox;
+        for (int t = from + step; t != to; t += step) {
+            // once lost, the tracker is not trusted anymore for this segment
+            if (!tracker->update(job.frames[t], box)) {
+                return;
+            }
+            boxes[t] = box;
+            ok[t] = true;
+        }
+    }
+
+    void propagate(const PropagationJob& job) {
+        const int n = (int) job.frames.size();
+        vector<Rect2d> fwd(n), bwd(n);
+        vector<bool> fwd_ok(n, false), bwd_ok(n, false);
+
+        // an open job is only tracked forward, up to its last frame included
+        const int end = job.closed ? n - 1 : n;
+        track(job, 0, end, job.first_box, fwd, fwd_ok);
+        if (job.closed) {
+            track(job, n - 1, 0, job.last_box, bwd, bwd_ok);
+        }
+
+        bool keys_ok = job.closed && job.first_box.area() > 0 && job.last_box.area() > 0;
+        for (int t = 1; t < end; t++) {
+            double w = (double) t / (n - 1);
+            Rect2d box;
+            char origin = BOX_TRACKED;
+
+            if (fwd_ok[t] && bwd_ok[t]) {
+                box = blendRect(fwd[t], bwd[t], w);
+            }
+            else if (fwd_ok[t]) {
+                box = fwd[t];
+            }
+            else if (bwd_ok[t]) {
+                box = bwd[t];
+            }
+            else if (keys_ok) {
+                box = blendRect(job.first_box, job.last_box, w);
+                origin = BOX_INTERPOLATED;
+            }
+            else {
+                origin = BOX_MISSING;
+            }
+
+            lock_guard<mutex> lock(m_mutex);
+            m_bounds[job.first + t] = box;
+            m_origin[job.first + t] = origin;
+        }
+    }
+
+    string m_trackername;
+    vector<Rect2d>& m_bounds;
+    vector<char>& m_origin;
+    thread m_worker;
+    mutex m_mutex;
+    condition_variable m_cond;
+    deque<PropagationJob> m_jobs;
+    size_t m_max_pending;
+    bool m_done;
+};
+
+static vector<Rect2d> cutKeyframes(const String videoname, int interval,
+                                   const string trackername, vector<char>& origin) {
+/*
+ * Keyframe annotation: the user selects the box every interval frames (and on
+ * the last frame) only, the frames in between are handed to the Propagator
+ */
+    vector<Rect2d> bounds;
+
+    VideoCapture video;
+    video.open(videoname);
+
+    if ( !video.isOpened() ) {
+        cerr << "Could not open video." << endl;
+        exit(1);
+    }
+
+    const size_t n_frames = (size_t) video.get(VideoCaptureProperties::CAP_PROP_FRAME_COUNT);
+    bounds.assign(n_frames, Rect2d());
+    origin.assign(n_frames, BOX_MISSING);
+
+    size_t n_read = 0;
+    {
+        Propagator propagator(trackername, bounds, origin);
+        PropagationJob job;
+        Mat frame;
+
+        namedWindow("Boundary Selection", WINDOW_NORMAL);
+        for (size_t i = 0; i < n_frames; ++i) {
+            bool ok = video.read(frame);
+            if (!ok) {
+                cerr << "(cutKeyframes) Problem occured in reading video frame\n";
+                break;
+            }
+            n_read = i + 1;
+            job.frames.push_back(frame.clone());
+
+            if (i % interval != 0 && i != n_frames - 1) {
+                continue;
+            }
+
+            Rect2d bbox = selectROI("Boundary Selection", frame);
+            propagator.setKeyframe(i, bbox);
+            cout << "keyframe " << i << " out of " << n_frames << ", "
+                 << propagator.pending() << " segments being propagated" << endl;
+
+            if (i > 0) {
+                job.last_box = bbox;
+                propagator.push(job);
+            }
+            job = PropagationJob();
+            job.first = i;
+            job.first_box = bbox;
+            job.frames.push_back(frame.clone());
+        }
+        destroyAllWindows();
+
+        // the read stopped early: the frames after the last keyframe are only
+        // tracked forward, those the tracker loses are flagged missing
+        if (job.frames.size() > 1) {
+            job.closed = false;
+            propagator.push(job);
+        }
+
+        cout << "Waiting for the propagation to finish" << endl;
+        propagator.finish();
+    }
+
+    bounds.resize(n_read);
+    origin.resize(n_read);
+    return bounds;
 }
 
-void save_box(vector<Rect2d> bounds, String fname) {
+static void save_origin(const vector<char>& origin, String fname) {
 /*
- * Save selected boundaries to file (txt)
- */ 
+ * Save the origin of every box, "FRAME K|P|I|M" per line,
+ * P and I frames are to be reviewed, M frames to be annotated
+ */
     ofstream fp;
     fp.open(fname);
-    
-    for ( vector<Rect2d>::iterator it = bounds.begin(); 
-          it != bounds.end(); it++) {
-         
-        fp << *it << "\n";
+
+    for (size_t i = 0; i < origin.size(); i++) {
+        fp << i << " " << origin[i] << "\n";
     }
-    
-    fp.close();
-    
-    cout << "Manually captured boundaries." << endl 
-         << "Saved as: " << fname << endl;
 
+    fp.close();
 }
 
 
 int main(int argc, char ** argv) {
 
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " VIDEO [KEYFRAME_INTERVAL [TRACKER]]" << endl;
+        return 1;
+    }
+
     string fname = argv[1];
     string ofname = fname;
     ofname.append(".txt");
-    vector<Rect2d> boundaries = cutRect(argv[1]); 
+    vector<Rect2d> boundaries;
+
+    if (argc >= 3 && atoi(argv[2]) > 1) {
+        vector<char> origin;
+        string trackername = argc >= 4 ? argv[3] : "CSRT";
+        boundaries = cutKeyframes(argv[1], atoi(argv[2]), trackername, origin);
+        save_origin(origin, ofname + ".flags");
+        cout << "Box origins (K: keyframe, P: propagated, I: interpolated, M: missing) saved as: "
+             << ofname << ".flags" << endl;
+    }
+    else {
+        boundaries = cutRect(argv[1]);
+    }
     
     save_box(boundaries, ofname);
+    cout << "Manually captured boundaries." << endl 
+         << "Saved as: " << ofname << endl;
     
     for (vector<Rect2d>::iterator it = boundaries.begin();
                              it != boundaries.end(); it++) {
@@ -20,47 +20,16 @@
 #include <fstream>
 #include <ctime>
 #include <unistd.h>
+#include "../include/iou.h"
+#include "../include/annot_io.h"
+#include "../include/img_corr.h"
+#include "../include/tracker_factory.h"
 
 
 using namespace std;
 using namespace cv;
 
 
-static Ptr<Tracker> createTrackerType(const string trackername) {
-    // create tracker according to the trackername specified
- 
-    Ptr<Tracker> tracker;
-    if (trackername == "MIL") {
-        tracker = TrackerMIL::create();
-    }
-    if (trackername == "Boosting") {
-        tracker = TrackerBoosting::create();
-    }
-    if (trackername == "KCF") {
-        tracker = TrackerKCF::create();
-    }
-    if (trackername == "TLD") {
-        tracker = TrackerTLD::create();
-    }
-    if (trackername == "MOSSE") {
-        tracker = TrackerMOSSE::create();
-    }
-    if (trackername == "CSRT") {
-        tracker = TrackerCSRT::create();
-    }
-    if (trackername == "MF") {
-        tracker = TrackerMedianFlow::create();
-    }
-    if (trackername == "HOG"){
-        //tracker = TrackerFeature::create("HOG");
-    }
-    if (trackername == "HAAR"){
-        //tracker = TrackerFeature::create("HAAR");
-    }
-    
-    return tracker;
-}
-
 static vector<Rect2d> cutRect(const String videoname) {
 
     vector<Rect2d> bounds;
@@ -102,8 +71,6 @@ static vector<Rect2d> cutRect(const String videoname) {
 vector<double> calculateIoU(const String videoname, Ptr<Tracker> tracker,
                                      vector<Rect2d> bounds, bool unbiased) {
                             
-    double IoU_eval(Rect2d bbox_a, Rect2d bbox_d);
-    double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg);
     
     // run the calculation according to the number of evaluation selected
     VideoCapture video;
@@ -163,111 +130,6 @@ vector<double> calculateIoU(const String videoname, Ptr<Tracker> tracker,
 
 
 
-double IoU_eval(Rect2d bbox_a, Rect2d bbox_d) {
-/* calculate IoU accuracy of label bbox and prediction box */
-
-    // bbox_a: annotation bbox, bbox_d: detection result bbox
-    Rect2d bbox_da = bbox_a & bbox_d;
-    
-    if ( bbox_da.area() == 0 ) {
-        return 0.0;
-    }
-    
-    double A_da = (double) bbox_da.area();
-    double A_d1a = (double) bbox_a.area() - A_da;
-    double A_da1 = (double) bbox_d.area() - A_da;
-    
-    //cout << A_da << " " << A_d1a << " " << A_da1 << endl; //dmsg
-    double acc = A_da / (A_da + A_d1a + A_da1);
-    return acc;
-}
-
-double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg) {
-/* calculate unbiased IoU accuracy of label bbox and prediction bbox 
- * According to the paper: Countering bias in tracking evaluations
- * by G. Hager et al, https://www.scitepress.org/Papers/2018/67148/67148.pdf
- */
-    // bbox_a: annotation bbox, bbox_d: detection result bbox 
-    Rect2d bbox_da = bbox_a & bbox_d;
-    
-    cout << bbox_d.area() << endl;
-    
-    // if they don't intersect at all => precision = 0 
-    if ( bbox_da.area() == 0 ) {
-        return 0.0;
-    }
-    
-    // A_d1a1 = A_bg - A_union(bbox_a, bbox_d): background area - area of union of two boxes
-    double A_da = (double) bbox_da.area();
-    double A_d1a = (double) bbox_a.area() - A_da;
-    double A_da1 = (double) bbox_d.area() - A_da;
-    double A_union_da = A_da + A_d1a + A_da1;
-
-    double A_d1a1 = A_bg - A_union_da;
-    
-    // cout << A_da << " " << A_d1a << " " << A_da1 << " " << A_d1a1 << endl; //dmsg
-    
-    // cast to double
-    double w0 = pow ((A_da + A_da1 + A_d1a),2)  / 
-                ( pow((A_da + A_da1 + A_d1a),2) + pow((A_d1a1 + A_da1 + A_d1a),2) ) ;
-                
-    double wbg = 1 - w0;
-    
-    double acc =   w0  *  A_da / (A_da + A_d1a + A_da1)  
-                 + wbg * A_d1a1 / (A_d1a1 + A_d1a + A_da1) ;
-    
-    return acc;
-    
-}
-
-vector<Rect2d> read_box(String fname) {
-/*
- * Read the saved file (txt) into a list of Rect2d
- */ 
- 
-    ifstream fp;
-    fp.open(fname);
-    
-    vector<String> saved_box;
-    
-    String line;
-    while (getline(fp,line)) {
-        saved_box.push_back(line);
-    }    
-    fp.close();
-
-    vector<Rect2d> read;
-    int w, h, x, y;
-    for (vector<String>::iterator it = saved_box.begin();
-         it != saved_box.end(); it++) {
-         
-        sscanf((*it).c_str(), "[%d x %d from (%d, %d)]", &w, &h, &x, &y);
-        read.push_back(Rect2d(x,y,w,h));
-    }
-    
-    return read;
-}
-
-void save_box(vector<Rect2d> bounds, String fname) {
-/*
- * Save selected boundaries to file (txt)
- */ 
-    ofstream fp;
-    fp.open(fname);
-    
-    for ( vector<Rect2d>::iterator it = bounds.begin(); 
-          it != bounds.end(); it++) {
-         
-        fp << *it << "\n";
-    }
-    
-    fp.close();
-    
-    cout << "Manually captured boundaries." << endl 
-         << "Saved as: " << fname << endl;
-
-}
-
 void drawrect(String vidname, String outfname, vector<Rect2d> bounds, const Scalar & colour) {
 
     VideoCapture video;
@@ -353,7 +215,6 @@ void calculateIoU_genvid(const string videoname, const string outfname,
                             string trackertype, vector<Rect2d> bounds, bool verbose) {
                             
     Ptr<Tracker> tracker = createTrackerType(trackertype);
-    double unbiased_IoU_eval(Rect2d bbox_a, Rect2d bbox_d, double A_bg);
     
     // run the calculation according to the number of evaluation selected
     VideoCapture video;
@@ -467,37 +328,6 @@ void calculateIoU_genvid(const string videoname, const string outfname,
     //return results;
 }
 
-static Mat bc_adjust(const Mat& orig_img, double alpha, double beta) {
-    
-    Mat new_img = Mat::zeros( orig_img.size(), orig_img.type() );
-    for( int y = 0; y < orig_img.rows; y++ ) {
-        for( int x = 0; x < orig_img.cols; x++ ) {
-            for( int c = 0; c < orig_img.channels(); c++ ) {
-                new_img.at<Vec3b>(y,x)[c] =
-                  saturate_cast<uchar>( alpha*orig_img.at<Vec3b>(y,x)[c] + beta );
-            }
-        }
-    }
-    return new_img;
-}
-
-static Mat gamma_corr(const Mat& orig_img, double gamma) {
-    
-    Mat new_img = Mat::zeros( orig_img.size(), orig_img.type() );
-    for( int y = 0; y < orig_img.rows; y++ ) {
-        for( int x = 0; x < orig_img.cols; x++ ) {
-            for( int c = 0; c < orig_img.channels(); c++ ) {
-                new_img.at<Vec3b>(y,x)[c] =
-                  saturate_cast<uchar>( pow( 
-                      (double) orig_img.at<Vec3b>(y,x)[c]/255, 
-                      gamma ) * 255 );
-            }
-        }
-    }
-    return new_img;
-}
-
-
 void vid_gamma_corr(const string vidname, double gamma) {
 
     VideoCapture video;
@@ -20,6 +20,7 @@
 #include <fstream>
 #include <ctime>
 #include <unistd.h>
+#include "../include/tracker_factory.h"
 
 
 using namespace std;
@@ -60,41 +61,6 @@ static Rect2d selectInit(const String videoname) {
 
 
 
-static Ptr<Tracker> createTrackerType(const string trackername) {
-    // create tracker according to the trackername specified
- 
-    Ptr<Tracker> tracker;
-    if (trackername == "MIL") {
-        tracker = TrackerMIL::create();
-    }
-    if (trackername == "Boosting") {
-        tracker = TrackerBoosting::create();
-    }
-    if (trackername == "KCF") {
-        tracker = TrackerKCF::create();
-    }
-    if (trackername == "TLD") {
-        tracker = TrackerTLD::create();
-    }
-    if (trackername == "MOSSE") {
-        tracker = TrackerMOSSE::create();
-    }
-    if (trackername == "CSRT") {
-        tracker = TrackerCSRT::create();
-    }
-    if (trackername == "MF") {
-        tracker = TrackerMedianFlow::create();
-    }
-    if (trackername == "HOG"){
-        //tracker = TrackerFeature::create("HOG");
-    }
-    if (trackername == "HAAR"){
-        //tracker = TrackerFeature::create("HAAR");
-    }
-    
-    return tracker;
-}
-
 
 void runTracking(const String videoname, Ptr<Tracker> tracker, Rect2d initbbox) {
 
@@ -18,42 +18,18 @@
 #include <iterator>
 #include <fstream>
 #include <unistd.h>
+#include "../include/img_corr.h"
+#include "../include/auto_exposure.h"
 
 
 using namespace std;
 using namespace cv;
 
-static Mat bc_adjust(const Mat& orig_img, double alpha, double beta) {
-    
-    Mat new_img = Mat::zeros( orig_img.size(), orig_img.type() );
-    for( int y = 0; y < orig_img.rows; y++ ) {
-        for( int x = 0; x < orig_img.cols; x++ ) {
-            for( int c = 0; c < orig_img.channels(); c++ ) {
-                new_img.at<Vec3b>(y,x)[c] =
-                  saturate_cast<uchar>( alpha*orig_img.at<Vec3b>(y,x)[c] + beta );
-            }
-        }
-    }
-    return new_img;
-}
-
-static Mat gamma_corr(const Mat& orig_img, double gamma) {
-    
-    Mat new_img = Mat::zeros( orig_img.size(), orig_img.type() );
-    for( int y = 0; y < orig_img.rows; y++ ) {
-        for( int x = 0; x < orig_img.cols; x++ ) {
-            for( int c = 0; c < orig_img.channels(); c++ ) {
-                new_img.at<Vec3b>(y,x)[c] =
-                  saturate_cast<uchar>( pow( 
-                      (double) orig_img.at<Vec3b>(y,x)[c]/255, 
-                      gamma ) * 255 );
-            }
-        }
-    }
-    return new_img;
-}
-
-void vid_gamma_corr(const string vidname, double gamma) {
+void vid_lut_corr(const string vidname, const Mat& lut) {
+/*
+ * Apply a 256-entry correction table to every frame, the table is computed
+ * once for the whole video and the frames are corrected in-place
+ */
 
     VideoCapture video;
     video.open(vidname);
@@ -65,7 +41,6 @@ void vid_gamma_corr(const string vidname, double gamma) {
 
                      video.get(CAP_PROP_FRAME_HEIGHT) ));    
     Mat frame;
-    Mat outframe;
     if ( !video.isOpened() ) {
         cerr << "Could not open video." << endl;
         exit(1);
@@ -78,15 +53,35 @@ void vid_gamma_corr(const string vidname, double gamma) {
                 cerr << "Problem occured during frame reading." << endl;
             }
             else {
-                outframe = gamma_corr(frame, gamma);
-                vout << outframe;
+                apply_lut(frame, lut, frame);
+                vout << frame;
             }
         }
     }
 }
 
 
+void vid_gamma_corr(const string vidname, double gamma) {
+    vid_lut_corr(vidname, gamma_lut(gamma));
+}
+
+
 void vid_bw_corr(const string vidname, double alpha, double beta) {
+    vid_lut_corr(vidname, bc_lut(alpha, beta));
+}
+
+
+void vid_gamma_bw_corr(const string vidname, double gamma, double alpha, double beta) {
+    // both corrections in one pass over the frame
+    vid_lut_corr(vidname, gamma_bc_lut(gamma, alpha, beta));
+}
+
+
+void vid_auto_corr(const string vidname) {
+/*
+ * Adaptive correction: gamma and contrast follow the running luminance
+ * histogram of the video, the table is only rebuilt when they change
+ */
 
     VideoCapture video;
     video.open(vidname);
@@ -98,7 +93,7 @@ void vid_bw_corr(const string vidname, double alpha, double beta) {
 
                      video.get(CAP_PROP_FRAME_HEIGHT) ));    
     Mat frame;
-    Mat outframe;
+    AutoExposure exposure;
     if ( !video.isOpened() ) {
         cerr << "Could not open video." << endl;
         exit(1);
@@ -111,23 +106,37 @@ void vid_bw_corr(const string vidname, double alpha, double beta) {
                 cerr << "Problem occured during frame reading." << endl;
             }
             else {
-                outframe = bc_adjust(frame, alpha, beta);
-                vout << outframe;
+                if (exposure.update(frame)) {
+                    cout << "frame " << i << ": gamma = " << exposure.gamma()
+                         << ", alpha = " << exposure.alpha()
+                         << ", beta = " << exposure.beta() << endl;
+                }
+                exposure.apply(frame, frame);
+                vout << frame;
             }
         }
+        cout << exposure.rebuilds() << " table updates for " << n_frames << " frames" << endl;
     }
 }
 
 
 int main(int argc, char ** argv) {
     string vidname = argv[1];
-    if (argc == 3) {
+    if (argc == 3 && string(argv[2]) == "auto") {
+        vid_auto_corr( vidname );
+    }
+
+    else if (argc == 3) {
         vid_gamma_corr( vidname, stod(argv[2]) );
     }
     
     else if (argc == 4) {
         vid_bw_corr( vidname, stod(argv[2]), stod(argv[3]) );
     }
+
+    else if (argc == 5) {
+        vid_gamma_bw_corr( vidname, stod(argv[2]), stod(argv[3]), stod(argv[4]) );
+    }
     return 0;
 }
 
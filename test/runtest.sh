@@ -1,5 +1,8 @@
 #!/bin/bash
 
+# A native, headless equivalent decoding the video only once is src/compare.cpp:
+# $ ./compare VIDEOPATH `python selectbbox.py VIDEOPATH`
+
 if [ $# != 2 ]; then
     echo "Bad argument, try -h for help"
 fi